@@ -37,6 +37,21 @@
 #include <WiFiManager.h>
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduler tasks and ready checks. The scheduler takes plain function pointers, so these hand
+// over to the (global) class objects, in the same way as our web and MQTT callbacks
+void task_Nextion() { nextion.loop(); }
+void task_Esp() { esp.loop(); }
+void task_Mqtt() { mqtt.loop(); }
+void task_ArduinoOta() { ArduinoOTA.handle(); }
+void task_Web() { web.loop(); }
+void task_WebSocket() { websocket.loop(); }
+void task_Beep() { beep.loop(); }
+void task_Debug() { debug.loop(); }
+bool ready_Nextion() { return Serial.available() > 0; }
+bool ready_Mqtt() { return mqtt.hasInput(); }
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void setup()
 { // System setup
@@ -52,23 +67,38 @@ void setup()
   Serial.swap();
 
   debug.begin();
+  trace.begin();
   nextion.begin();
 
-  debug.printLn(SYSTEM,String(F("SYSTEM: Starting HASwitchPlate v")) + String(config.getHaspVersion()));
-  debug.printLn(SYSTEM,String(F("SYSTEM: Last reset reason: ")) + String(ESP.getResetInfo()));
-  debug.printLn(SYSTEM,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
-  debug.printLn(SYSTEM,String(F("SYSTEM: espCore: ")) + String(ESP.getCoreVersion()) );
+  DEBUG_PRINTLN(SYSTEM,String(F("SYSTEM: Starting HASwitchPlate v")) + String(config.getHaspVersion()));
+  DEBUG_PRINTLN(SYSTEM,String(F("SYSTEM: Last reset reason: ")) + String(ESP.getResetInfo()));
+  DEBUG_PRINTLN(SYSTEM,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
+  DEBUG_PRINTLN(SYSTEM,String(F("SYSTEM: espCore: ")) + String(ESP.getCoreVersion()) );
 
   config.begin();
   esp.begin();
 
-  debug.printLn(SYSTEM,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
+  DEBUG_PRINTLN(SYSTEM,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
 
   web.begin();
+  websocket.begin();
   mqtt.begin();
   beep.begin();
 
-  debug.printLn(SYSTEM,F("SYSTEM: System init complete."));
+#if SCHEDULER_ENABLED==(true)
+  // name, trace phase, work, period in msec, priority (0 first), ready check
+  scheduler.add("nextion", PHASE_NEXTION, task_Nextion, 20, 0, ready_Nextion);        // touches, as soon as a byte lands
+  scheduler.add("mqtt", PHASE_MQTT, task_Mqtt, 50, 1, ready_Mqtt);                    // commands, and keepalive on the period
+  scheduler.add("beep", PHASE_BEEP, task_Beep, 10, 2);
+  scheduler.add("websocket", PHASE_WEBSOCKET, task_WebSocket, 20, 3);
+  scheduler.add("web", PHASE_WEB, task_Web, 20, 4);
+  scheduler.add("debug", PHASE_DEBUG, task_Debug, 10, 5);                            // about a FIFO of serial at 115200
+  scheduler.add("esp", PHASE_ESP, task_Esp, 100, 6);                                 // WiFi check, motion, update timer
+  scheduler.add("arduinoota", PHASE_OTA, task_ArduinoOta, 100, 7);
+  scheduler.begin();
+#endif
+
+  DEBUG_PRINTLN(SYSTEM,F("SYSTEM: System init complete."));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -81,12 +111,36 @@ void loop()
   // * ArduinoOTA
   // * MQTT Last-Will-and-Testament
 
+  uint32_t loopStart = micros();
+
+#if SCHEDULER_ENABLED==(true)
+  bool loopBusy = scheduler.loop();
+  esp.noteLoopMicros(micros() - loopStart);
+  if (!loopBusy)
+  { // outside the timing above, a sleep isn't a stall
+    scheduler.idle();
+  }
+#else
+  trace.phase(PHASE_NEXTION);
   nextion.loop();
+  trace.phase(PHASE_ESP);
   esp.loop();
+  trace.phase(PHASE_MQTT);
   mqtt.loop();
+  trace.phase(PHASE_OTA);
   ArduinoOTA.handle();      // Arduino OTA loop
+  trace.phase(PHASE_WEB);
   web.loop();
+  trace.phase(PHASE_WEBSOCKET);
+  websocket.loop();
+  trace.phase(PHASE_BEEP);
   beep.loop();
+  trace.phase(PHASE_DEBUG);
+  debug.loop();             // drain the debug log to serial, telnet and WebSocket
+  trace.phase(PHASE_IDLE);
+
+  esp.noteLoopMicros(micros() - loopStart);
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
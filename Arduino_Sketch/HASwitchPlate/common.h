@@ -44,3 +44,15 @@ COMMON_EXTERN WebClass web;  // our HTTP Server Object
 
 #include "speaker_class.h"
 COMMON_EXTERN SpeakerClass beep;  // our Speaker Object
+
+#include "websocket_class.h"
+COMMON_EXTERN WebSocketClass websocket;  // our WebSocket event stream
+
+#include "trace_class.h"
+COMMON_EXTERN TraceClass trace;  // our binary event trace
+
+#include "scheduler_class.h"
+COMMON_EXTERN SchedulerClass scheduler;  // runs our loop() work when it is due
+
+#include "latency_class.h"
+COMMON_EXTERN LatencyClass latency;  // end to end latency percentiles
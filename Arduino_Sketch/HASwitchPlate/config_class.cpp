@@ -101,10 +101,42 @@ void ConfigClass::readFile()
           {
             debug.enableTelnet(configJson["debugTelnetEnabled"]); // debug, config, or both?
           }
+          if (!configJson["debugSyslogServer"].isNull())
+          {
+            debug.setSyslogServer(configJson["debugSyslogServer"]);
+          }
           if (!configJson["mdnsEnabled"].isNull())
           {
             setMDSNEnabled(configJson["mdnsEnabled"]);
           }
+          if (!configJson["mqttPersistent"].isNull())
+          {
+            setMQTTPersistent(configJson["mqttPersistent"]);
+          }
+          if (!configJson["mqttSnapshot"].isNull())
+          {
+            setMQTTSnapshot(configJson["mqttSnapshot"]);
+          }
+          if (!configJson["mqttBufferSize"].isNull())
+          {
+            setMQTTBufferSize(configJson["mqttBufferSize"]);
+          }
+          if (!configJson["mqttTls"].isNull())
+          {
+            setMQTTTls(configJson["mqttTls"]);
+          }
+          if (!configJson["mqttFingerprint"].isNull())
+          {
+            setMQTTFingerprint(configJson["mqttFingerprint"]);
+          }
+          if (!configJson["mqttTlsInsecure"].isNull())
+          {
+            setMQTTTlsInsecure(configJson["mqttTlsInsecure"]);
+          }
+          if (!configJson["mqttTlsMfln"].isNull())
+          {
+            setMQTTTlsMfln(configJson["mqttTlsMfln"]);
+          }
           if (!configJson["beepEnabled"].isNull())
           {
             beep.enable(configJson["beepEnabled"]);
@@ -163,21 +195,37 @@ void ConfigClass::saveFile()
   jsonConfigValues["motionPinConfig"] = _motionPin;
   jsonConfigValues["debugSerialEnabled"] = debug.getSerialEnabled();
   jsonConfigValues["debugTelnetEnabled"] = debug.getTelnetEnabled();
+  jsonConfigValues["debugSyslogServer"] = debug.getSyslogServer();
   jsonConfigValues["mdnsEnabled"] = _mdnsEnabled;
+  jsonConfigValues["mqttPersistent"] = _mqttPersistent;
+  jsonConfigValues["mqttSnapshot"] = _mqttSnapshot;
+  jsonConfigValues["mqttBufferSize"] = _mqttBufferSize;
+  jsonConfigValues["mqttTls"] = _mqttTls;
+  jsonConfigValues["mqttFingerprint"] = _mqttFingerprint;
+  jsonConfigValues["mqttTlsInsecure"] = _mqttTlsInsecure;
+  jsonConfigValues["mqttTlsMfln"] = _mqttTlsMfln;
   jsonConfigValues["beepEnabled"] = beep.getEnable();
 
   debug.printLn(String(F("SPIFFS: mqttServer = ")) + String(_mqttServer));
   debug.printLn(String(F("SPIFFS: mqttPort = ")) + String(_mqttPort));
   debug.printLn(String(F("SPIFFS: mqttUser = ")) + String(_mqttUser));
-  debug.printLn(String(F("SPIFFS: mqttPassword = ")) + String(_mqttPassword));
+  debug.printLn(String(F("SPIFFS: mqttPassword = ")) + String((_mqttPassword[0] != '\0') ? F("********") : F("")));
   debug.printLn(String(F("SPIFFS: haspNode = ")) + String(_haspNode));
   debug.printLn(String(F("SPIFFS: groupName = ")) + String(_groupName));
   debug.printLn(String(F("SPIFFS: configUser = ")) + String(web.getUser()));
-  debug.printLn(String(F("SPIFFS: configPassword = ")) + String(web.getPassword()));
+  debug.printLn(String(F("SPIFFS: configPassword = ")) + String((web.getPassword()[0] != '\0') ? F("********") : F("")));
   debug.printLn(String(F("SPIFFS: motionPinConfig = ")) + String(_motionPin));
   debug.printLn(String(F("SPIFFS: debugSerialEnabled = ")) + String(debug.getSerialEnabled()));
   debug.printLn(String(F("SPIFFS: debugTelnetEnabled = ")) + String(debug.getTelnetEnabled()));
+  debug.printLn(String(F("SPIFFS: debugSyslogServer = ")) + String(debug.getSyslogServer()));
   debug.printLn(String(F("SPIFFS: mdnsEnabled = ")) + String(_mdnsEnabled));
+  debug.printLn(String(F("SPIFFS: mqttPersistent = ")) + String(_mqttPersistent));
+  debug.printLn(String(F("SPIFFS: mqttSnapshot = ")) + String(_mqttSnapshot));
+  debug.printLn(String(F("SPIFFS: mqttBufferSize = ")) + String(_mqttBufferSize));
+  debug.printLn(String(F("SPIFFS: mqttTls = ")) + String(_mqttTls));
+  debug.printLn(String(F("SPIFFS: mqttFingerprint = ")) + String(_mqttFingerprint));
+  debug.printLn(String(F("SPIFFS: mqttTlsInsecure = ")) + String(_mqttTlsInsecure));
+  debug.printLn(String(F("SPIFFS: mqttTlsMfln = ")) + String(_mqttTlsMfln));
   debug.printLn(String(F("SPIFFS: beepEnabled = ")) + String(beep.getEnable()));
 
   File configFile = SPIFFS.open("/config.json", "w");
@@ -45,6 +45,13 @@ public:
     setGroupName(DEFAULT_GROUP_NAME);
     setMotionPin(DEFAULT_MOTION_PIN);
     setMDSNEnabled(MDNS_ENABLED);
+    setMQTTPersistent(MQTT_PERSISTENT_SESSION);
+    setMQTTSnapshot(MQTT_SNAPSHOT_ENABLED);
+    setMQTTBufferSize(MQTT_PACKET_SIZE);
+    setMQTTTls(MQTT_TLS_ENABLED);
+    setMQTTFingerprint(DEFAULT_MQTT_FINGERPRINT);
+    setMQTTTlsInsecure(MQTT_TLS_INSECURE);
+    setMQTTTlsMfln(MQTT_TLS_MFLN_UNKNOWN);
     setMotionEnabled(MOTION_ENABLED);
     setLcdFirmwareUrl(DEFAULT_URL_LCD_FW);
     setEspFirmwareUrl(DEFAULT_URL_ARDUINO_FW);
@@ -114,6 +121,29 @@ public:
   bool getMDNSEnabled(void) { return _mdnsEnabled; }
   void setMDSNEnabled(bool value) { _mdnsEnabled=value; }
 
+  bool getMQTTPersistent(void) { return _mqttPersistent; }
+  void setMQTTPersistent(bool value) { _mqttPersistent=value; }
+
+  bool getMQTTSnapshot(void) { return _mqttSnapshot; }
+  void setMQTTSnapshot(bool value) { _mqttSnapshot=value; }
+
+  uint16_t getMQTTBufferSize(void) { return _mqttBufferSize; }
+  // 0 sizes it from free heap, anything else is kept to the range _choosePacketSize() would pick from
+  void setMQTTBufferSize(int32_t value) { _mqttBufferSize = (value == 0) ? 0 : constrain(value, MQTT_MIN_PACKET_SIZE, MQTT_MAX_PACKET_SIZE); }
+
+  bool getMQTTTls(void) { return _mqttTls; }
+  void setMQTTTls(bool value) { _mqttTls=value; }
+
+  char *getMQTTFingerprint(void) { return _mqttFingerprint; }
+  void setMQTTFingerprint(const char *value) { strncpy(_mqttFingerprint, value, 60); _mqttFingerprint[59]='\0'; }
+
+  bool getMQTTTlsInsecure(void) { return _mqttTlsInsecure; }
+  void setMQTTTlsInsecure(bool value) { _mqttTlsInsecure=value; }
+
+  // did the broker agree to MQTT_TLS_FRAGMENT_SIZE records, so the probe runs once per broker rather than every boot
+  uint8_t getMQTTTlsMfln(void) { return _mqttTlsMfln; }
+  void setMQTTTlsMfln(uint8_t value) { _mqttTlsMfln=value; }
+
   bool getSaveNeeded(void) { return _shouldSaveConfig; }
   void setSaveNeeded(void) { _shouldSaveConfig=true; }
 
@@ -154,6 +184,13 @@ protected:
   char _motionPin[3];
   bool _motionEnabled;                     // Motion sensor is enabled
   bool _mdnsEnabled;                       // mDNS is enabled
+  bool _mqttPersistent;                    // MQTT session is kept by the broker across reconnects (cleanSession=false)
+  bool _mqttSnapshot;                      // Restore retained panel attributes from the snapshot topic tree at connect
+  uint16_t _mqttBufferSize;                // Size of MQTT packet buffer, 0 to size it from free heap at boot
+  bool _mqttTls;                           // Connect to the MQTT broker with TLS
+  char _mqttFingerprint[60];               // SHA1 fingerprint of the broker certificate, "AA:BB:..." or blank
+  bool _mqttTlsInsecure;                   // Blank fingerprint means accept any certificate, rather than refuse to connect
+  uint8_t _mqttTlsMfln;                    // MQTT_TLS_MFLN_UNKNOWN, _YES or _NO for the configured broker
   bool _shouldSaveConfig;                  // Flag to save json config to SPIFFS
 
   const float _haspVersion = HASP_VERSION; // Current HASP software release version
@@ -18,6 +18,24 @@
 void debugClass::printLn(String debugText)
 {
   // Debug output line of text to our debug targets
+  uint32_t appendStart = micros();
+  trace.line(debugText); // the newest lines survive a reset in RTC memory
+#if DEBUG_LOG_ASYNC==(true)
+  // Just copy it into the ring, loop() hands it to the slow outputs when they have room
+  char debugTimeText[20];
+  uint32_t debugMillis = millis();
+  snprintf_P(debugTimeText, sizeof(debugTimeText), PSTR("[+%lu.%03lus] "), (unsigned long)(debugMillis / 1000), (unsigned long)(debugMillis % 1000));
+  _logAppend(debugTimeText, strlen(debugTimeText));
+  _logAppend(debugText.c_str(), debugText.length());
+  _logAppend("\r\n", 2);
+  _noteAppendMicros(micros() - appendStart);
+  if (!_logFlushing && (!_logLoopRunning || ((millis() - _logLastLoop) > DEBUG_LOG_STALL_MS)))
+  { // still in setup(), or stuck in a wait or an OTA that never gets back to loop(). Nobody drains
+    // the ring for us there, so write it out now as the old inline code did
+    flush();
+    _noteSyncMicros(micros() - appendStart);
+  }
+#else
   String debugTimeText = "[+" + String(float(millis()) / 1000, 3) + "s] " + debugText;
   Serial.println(debugTimeText);
   if (_serialEnabled)
@@ -28,6 +46,10 @@ void debugClass::printLn(String debugText)
     debugSerial.flush();
   }
   web.telnetPrintLn(_telnetEnabled, debugTimeText);
+  websocket.sendLog(debugTimeText);
+  _noteAppendMicros(micros() - appendStart);
+  _noteSyncMicros(micros() - appendStart);
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,6 +59,9 @@ void debugClass::print(String debugText)
   // character requires a full TCP round-trip + acknowledgement back and execution halts while this
   // happens.  Far better to put everything into a line and send it all out in one packet using
   // debugPrintln.
+#if DEBUG_LOG_ASYNC==(true)
+  _logAppend(debugText.c_str(), debugText.length());
+#else
   Serial.print(debugText);
   if (_serialEnabled)
   {
@@ -46,4 +71,333 @@ void debugClass::print(String debugText)
     debugSerial.flush();
   }
   web.telnetPrint(_telnetEnabled, debugText);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::loop(void)
+{ // Give each output what it can take right now, and no more
+  _logLoopRunning = true;
+  _logLastLoop = millis();
+  if (_logCaughtUp())
+  { // nothing new, the common case
+    return;
+  }
+  uint32_t drainStart = micros();
+  _logDrainAll();
+  uint32_t drainMicros = micros() - drainStart;
+  if (drainMicros > _logDrainMaxMicros)
+  {
+    _logDrainMaxMicros = drainMicros;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::flush(uint32_t timeout)
+{ // Keep draining until every output has caught up, or we run out of time
+  uint32_t flushStart = millis();
+  _logFlushing = true;
+  while ((millis() - flushStart) < timeout)
+  {
+    _logDrainAll();
+    if (_logCaughtUp())
+    {
+      break;
+    }
+    delay(1);
+  }
+  _logFlushing = false;
+  Serial.flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_logDrainAll(void)
+{ // One pass over every output
+  _logDrain(SINK_SERIAL, Serial.availableForWrite());
+  if (_serialEnabled)
+  { // no FIFO to ask, so a fixed slice of bytes each pass. Each byte is ~87usec of bit-banging
+    _logDrain(SINK_SOFTSERIAL, DEBUG_SOFT_SERIAL_BUDGET);
+  }
+  else
+  {
+    _logTail[SINK_SOFTSERIAL] = _logHead;
+  }
+  _logDrain(SINK_TELNET, web.telnetAvailableForWrite(_telnetEnabled));
+  _logDrainLines(DEBUG_WEBSOCKET_LINES);
+  _logDrainSyslog();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_logAppend(const char *text, size_t length)
+{ // O(1) for every line except one that laps a slow output, which then skips to its next whole line
+  if (length > (DEBUG_LOG_RING_SIZE / 2))
+  { // a single monster line may not push out everything else
+    length = DEBUG_LOG_RING_SIZE / 2;
+  }
+  uint32_t headIndex = _logHead % DEBUG_LOG_RING_SIZE;
+  size_t firstPart = DEBUG_LOG_RING_SIZE - headIndex;
+  if (firstPart > length)
+  {
+    firstPart = length;
+  }
+  memcpy(&_logRing[headIndex], text, firstPart);
+  memcpy(&_logRing[0], text + firstPart, length - firstPart);
+  _logHead += length;
+
+  for (uint8_t sink = 0; sink < SINK_COUNT; sink++)
+  {
+    if ((_logHead - _logTail[sink]) > DEBUG_LOG_RING_SIZE)
+    { // this output fell a whole ring behind, lose its oldest text up to a line boundary
+      uint32_t newTail = _logHead - DEBUG_LOG_RING_SIZE;
+      while ((newTail < _logHead) && (_logRing[newTail % DEBUG_LOG_RING_SIZE] != '\n'))
+      {
+        newTail++;
+      }
+      if (newTail < _logHead)
+      {
+        newTail++; // past the newline
+      }
+      _logDropped += newTail - _logTail[sink];
+      if (sink == SINK_SYSLOG)
+      {
+        _syslogDropped += newTail - _logTail[sink];
+      }
+      _logTail[sink] = newTail;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_logDrain(sink_t sink, size_t room)
+{ // Write up to room bytes of the ring to one byte-stream output
+  while ((room > 0) && (_logTail[sink] != _logHead))
+  {
+    uint32_t tailIndex = _logTail[sink] % DEBUG_LOG_RING_SIZE;
+    size_t chunk = _logHead - _logTail[sink];
+    if (chunk > (DEBUG_LOG_RING_SIZE - tailIndex))
+    { // don't run off the end of the ring, the rest comes on the next time around
+      chunk = DEBUG_LOG_RING_SIZE - tailIndex;
+    }
+    if (chunk > room)
+    {
+      chunk = room;
+    }
+    if (sink == SINK_SERIAL)
+    {
+      Serial.write((const uint8_t *)&_logRing[tailIndex], chunk);
+    }
+    else if (sink == SINK_SOFTSERIAL)
+    {
+      if (_debugSerial == NULL)
+      {
+        _debugSerial = new SoftwareSerial(-1, 1); // -1==nc for RX, 1==TX pin
+        _debugSerial->begin(115200);
+      }
+      _debugSerial->write((const uint8_t *)&_logRing[tailIndex], chunk);
+    }
+    else if (sink == SINK_TELNET)
+    {
+      web.telnetWrite((const uint8_t *)&_logRing[tailIndex], chunk);
+    }
+    _logTail[sink] += chunk;
+    room -= chunk;
+  }
+  if ((sink == SINK_TELNET) && !web.telnetConnected(_telnetEnabled))
+  { // nobody listening, don't hold text for them
+    _logTail[sink] = _logHead;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_logDrainLines(uint8_t maxLines)
+{ // The WebSocket takes whole lines as JSON messages, and queues them itself
+  if (websocket.getClientCount() == 0)
+  {
+    _logTail[SINK_WEBSOCKET] = _logHead;
+    return;
+  }
+  while ((maxLines > 0) && (_logTail[SINK_WEBSOCKET] != _logHead))
+  {
+    uint32_t lineEnd = _logTail[SINK_WEBSOCKET];
+    while ((lineEnd < _logHead) && (_logRing[lineEnd % DEBUG_LOG_RING_SIZE] != '\n'))
+    {
+      lineEnd++;
+    }
+    if (lineEnd == _logHead)
+    {
+      return; // only part of a line so far
+    }
+    String logLine;
+    logLine.reserve(lineEnd - _logTail[SINK_WEBSOCKET]);
+    for (uint32_t pos = _logTail[SINK_WEBSOCKET]; pos < lineEnd; pos++)
+    {
+      char logChar = _logRing[pos % DEBUG_LOG_RING_SIZE];
+      if (logChar != '\r')
+      {
+        logLine += logChar;
+      }
+    }
+    websocket.sendLog(logLine);
+    _logTail[SINK_WEBSOCKET] = lineEnd + 1;
+    maxLines--;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_logDrainSyslog(void)
+{ // Whole lines, batched into one datagram once a batch has built up or the oldest line has waited long enough.
+  // At most one datagram per pass and DEBUG_SYSLOG_RATE a second, beyond that the ring holds the text or loses it
+  if (_syslogServer[0] == '\0')
+  { // not configured, don't hold text for it
+    _logTail[SINK_SYSLOG] = _logHead;
+    return;
+  }
+  uint32_t pending = _logHead - _logTail[SINK_SYSLOG];
+  if (pending == 0)
+  {
+    _syslogWaitStart = 0;
+    return;
+  }
+  uint32_t now = millis();
+  if (_syslogWaitStart == 0)
+  {
+    _syslogWaitStart = now | 1;
+  }
+  if (!_logFlushing && (pending < DEBUG_SYSLOG_BATCH_SIZE) && ((now - _syslogWaitStart) < DEBUG_SYSLOG_LINGER))
+  { // give a few more lines the chance to share this datagram
+    return;
+  }
+  if (WiFi.status() != WL_CONNECTED)
+  { // hold on to it, the ring counts anything we lose while we wait
+    return;
+  }
+  if (!_syslogAddress.isSet())
+  { // didn't resolve, resolveSyslogServer() tries again at the next WiFi connect
+    return;
+  }
+
+  // token bucket, refilled at DEBUG_SYSLOG_RATE a second
+  uint32_t elapsed = now - _syslogRefill;
+  if (elapsed > ASECOND)
+  {
+    elapsed = ASECOND;
+  }
+  uint32_t refill = (elapsed * DEBUG_SYSLOG_RATE) / ASECOND;
+  if (refill > 0)
+  {
+    _syslogTokens = ((_syslogTokens + refill) > DEBUG_SYSLOG_RATE) ? DEBUG_SYSLOG_RATE : (_syslogTokens + refill);
+    _syslogRefill = now;
+  }
+  if (_syslogTokens == 0)
+  {
+    return;
+  }
+
+  // RFC 5424 header. No clock, so a nil TIMESTAMP and uptime in meta instead
+  char header[160];
+  _syslogSequence = (_syslogSequence % 2147483647) + 1;
+  int headerLength = snprintf_P(header, sizeof(header), PSTR("<%u>1 - %s hasp - log [meta sequenceId=\"%lu\" sysUpTime=\"%lu\"][hasp@32473 dropped=\"%lu\"] "),
+                                (unsigned int)DEBUG_SYSLOG_PRI, config.getHaspNode(), (unsigned long)_syslogSequence, (unsigned long)(now / 10), (unsigned long)_syslogDropped);
+  if ((headerLength < 0) || (headerLength >= (int)sizeof(header)))
+  {
+    headerLength = sizeof(header) - 1;
+  }
+
+  // up to the last line end that fits, or a slice of one line too long to ever fit
+  uint32_t batchLimit = _logTail[SINK_SYSLOG] + (DEBUG_SYSLOG_BATCH_SIZE - headerLength);
+  if (batchLimit > _logHead)
+  {
+    batchLimit = _logHead;
+  }
+  uint32_t batchEnd = _logTail[SINK_SYSLOG];
+  for (uint32_t pos = _logTail[SINK_SYSLOG]; pos < batchLimit; pos++)
+  {
+    if (_logRing[pos % DEBUG_LOG_RING_SIZE] == '\n')
+    {
+      batchEnd = pos + 1;
+    }
+  }
+  if (batchEnd == _logTail[SINK_SYSLOG])
+  {
+    if (batchLimit == _logHead)
+    {
+      return; // only part of a line so far
+    }
+    batchEnd = batchLimit;
+  }
+
+  bool sent = _syslogUdp.beginPacket(_syslogAddress, _syslogPort);
+  if (sent)
+  {
+    _syslogUdp.write((const uint8_t *)header, headerLength);
+    _syslogWrite(_logTail[SINK_SYSLOG], batchEnd);
+    sent = _syslogUdp.endPacket();
+  }
+  if (sent)
+  {
+    _syslogSent++;
+  }
+  else
+  {
+    _syslogDropped += batchEnd - _logTail[SINK_SYSLOG];
+  }
+  _syslogTokens--;
+  _logTail[SINK_SYSLOG] = batchEnd;
+  if (_logTail[SINK_SYSLOG] == _logHead)
+  {
+    _syslogWaitStart = 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::resolveSyslogServer()
+{ // "host" or "host:port" to an address, an IP address costs nothing but a name is a blocking DNS lookup
+  _syslogAddress = IPAddress();
+  if ((_syslogServer[0] == '\0') || (WiFi.status() != WL_CONNECTED))
+  { // nothing to look up, or no network to look it up on yet
+    return;
+  }
+  char syslogHost[64];
+  strncpy(syslogHost, _syslogServer, sizeof(syslogHost));
+  syslogHost[sizeof(syslogHost) - 1] = '\0';
+  char *syslogPort = strchr(syslogHost, ':');
+  _syslogPort = DEBUG_SYSLOG_PORT;
+  if (syslogPort != NULL)
+  { // "host:port"
+    *syslogPort = '\0';
+    _syslogPort = atoi(syslogPort + 1);
+  }
+  if (!WiFi.hostByName(syslogHost, _syslogAddress, 1000) || !_syslogAddress.isSet() || (_syslogPort == 0))
+  {
+    _syslogAddress = IPAddress();
+    printLn(String(F("DEBUG: syslog server '")) + String(_syslogServer) + String(F("' did not resolve, syslog output is off until WiFi reconnects")));
+    return;
+  }
+  printLn(String(F("DEBUG: syslog to ")) + _syslogAddress.toString() + ":" + String(_syslogPort));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void debugClass::_syslogWrite(uint32_t from, uint32_t to)
+{ // Ring text into the open datagram, lines split by bare newlines and no newline after the last one
+  while ((to > from) && ((_logRing[(to - 1) % DEBUG_LOG_RING_SIZE] == '\n') || (_logRing[(to - 1) % DEBUG_LOG_RING_SIZE] == '\r')))
+  {
+    to--;
+  }
+  uint8_t chunk[128];
+  size_t used = 0;
+  for (uint32_t pos = from; pos < to; pos++)
+  {
+    char logChar = _logRing[pos % DEBUG_LOG_RING_SIZE];
+    if (logChar == '\r')
+    {
+      continue;
+    }
+    chunk[used++] = logChar;
+    if (used == sizeof(chunk))
+    {
+      _syslogUdp.write(chunk, used);
+      used = 0;
+    }
+  }
+  _syslogUdp.write(chunk, used);
 }
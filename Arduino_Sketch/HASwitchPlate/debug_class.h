@@ -17,6 +17,7 @@
 #include <Arduino.h>
 #include <WiFiClient.h>
 #include <SoftwareSerial.h>
+#include <WiFiUdp.h>
 
 enum source_t {
   HMI=0,
@@ -25,10 +26,20 @@ enum source_t {
   WIFI
 };
 
+// each place the log ring drains to, with its own read position
+enum sink_t {
+  SINK_SERIAL=0,   // hardware Serial TX
+  SINK_SOFTSERIAL, // bit-banged USB debug on pin 1
+  SINK_TELNET,
+  SINK_WEBSOCKET,
+  SINK_SYSLOG,     // RFC 5424 over UDP, several lines to a datagram
+  SINK_COUNT
+};
+
 class debugClass {
 private:
 public:
-  debugClass( void) { _alive = false;};
+  debugClass( void) { _alive = false; _debugSerial = NULL; _logHead = 0; _logDropped = 0; _logAppendMaxMicros = 0; _logDrainMaxMicros = 0; _logSyncMaxMicros = 0; _logLoopRunning = false; _logLastLoop = 0; _logFlushing = false; _syslogServer[0] = '\0'; _syslogPort = DEBUG_SYSLOG_PORT; _syslogWaitStart = 0; _syslogTokens = DEBUG_SYSLOG_RATE; _syslogRefill = 0; _syslogSequence = 0; _syslogSent = 0; _syslogDropped = 0; for (uint8_t sink = 0; sink < SINK_COUNT; sink++) { _logTail[sink] = 0; } for (uint8_t source = 0; source <= WIFI; source++) { _logSkipped[source] = 0; } };
   ~debugClass(void) { _alive = false;};
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -41,9 +52,26 @@ public:
     _verboseDebugWiFi   = true;
     _telnetEnabled      = DEBUG_TELNET_ENABLED;
     _serialEnabled      = DEBUG_SERIAL_ENABLED;
+    setSyslogServer(DEFAULT_SYSLOG_SERVER);
     _alive              = true;
   }
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // called in the main code loop, drains the log ring to each output as far as it will take without blocking
+  void loop(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // drain everything, blocking for up to timeout msec. Before a reset, so the last words get out
+  void flush(uint32_t timeout = 500);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getLogAppendMaxMicros() { return _logAppendMaxMicros; }
+  inline uint32_t getLogDrainMaxMicros() { return _logDrainMaxMicros; }
+  inline uint32_t getLogSyncMaxMicros() { return _logSyncMaxMicros; }
+  inline uint32_t getLogDropped() { return _logDropped; }
+  inline uint32_t getSyslogSent() { return _syslogSent; }
+  inline uint32_t getSyslogDropped() { return _syslogDropped; }
+
   inline void enableSerial(bool enable=true)   { _serialEnabled = enable; }
   inline void disableSerial(bool enable=false) { _serialEnabled = enable; }
   inline void enableTelnet(bool enable=true)   { _telnetEnabled = enable; }
@@ -52,6 +80,15 @@ public:
   inline bool getSerialEnabled() { return _serialEnabled; }
   inline bool getTelnetEnabled() { return _telnetEnabled; }
 
+  // "host" or "host:port", blank turns the syslog output off
+  inline char *getSyslogServer() { return _syslogServer; }
+  inline void setSyslogServer(const char *value) { strncpy(_syslogServer, value, 64); _syslogServer[63] = '\0'; resolveSyslogServer(); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // look up _syslogServer. A DNS lookup blocks, so this runs when the setting changes and when WiFi
+  // (re)connects, never from loop()
+  void resolveSyslogServer();
+
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void printLn(String debugText);
@@ -62,6 +99,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   inline void printLn( enum source_t source, String debugText )
   { // a wrapper version that might print or might not
+    // NB: debugText is already built by the time we get here, prefer DEBUG_PRINTLN() below
     if( source == HMI    && _verboseDebugHMI)    { printLn(debugText); }
     if( source == MQTT   && _verboseDebugMQTT)   { printLn(debugText); }
     if( source == WIFI   && _verboseDebugWiFi)   { printLn(debugText); }
@@ -74,6 +112,21 @@ public:
   inline void printLnSystem( String debugText ) { if( _verboseDebugSystem ) { printLn(debugText); } }
   inline void printLnWiFi(   String debugText ) { if( _verboseDebugWiFi )   { printLn(debugText); } }
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline bool getVerbose( enum source_t source )
+  { // is this source printing right now
+    if( source == HMI)    { return _verboseDebugHMI; }
+    if( source == MQTT)   { return _verboseDebugMQTT; }
+    if( source == WIFI)   { return _verboseDebugWiFi; }
+    if( source == SYSTEM) { return _verboseDebugSystem; }
+    return false;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // every DEBUG_PRINTLN() that was not printed is a String build (one or more heap allocations) saved
+  inline void noteSkipped( enum source_t source ) { _logSkipped[source]++; }
+  inline uint32_t getLogSkipped( enum source_t source ) { return _logSkipped[source]; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   inline void verbosity( enum source_t source, bool verbose=false)
   { // enable or disable printing blocks
@@ -92,4 +145,78 @@ protected:
   bool _verboseDebugMQTT;   // set false to have fewer printf from MQTT
   bool _verboseDebugSystem; // set false to have fewer printf from System
   bool _verboseDebugWiFi;   // set false to have fewer printf from WiFi
+  SoftwareSerial *_debugSerial;         // USB debug TX, made once on first use
+  char     _logRing[DEBUG_LOG_RING_SIZE]; // pending log text for all sinks
+  uint32_t _logHead;                    // bytes ever appended, the ring index is this modulo the size
+  uint32_t _logTail[SINK_COUNT];        // bytes each sink has taken. Only loop() moves these, only printLn() moves _logHead
+  uint32_t _logDropped;                 // bytes a slow sink lost to being overwritten
+  uint32_t _logAppendMaxMicros;         // worst time spent inside one printLn()
+  uint32_t _logDrainMaxMicros;          // worst time spent inside one loop() drain
+  uint32_t _logSyncMaxMicros;           // worst printLn() that wrote its outputs inline, the cost without the ring
+  uint32_t _logSkipped[WIFI + 1];       // DEBUG_PRINTLN() calls per source that never built their text
+  bool     _logLoopRunning;             // loop() has started draining, until then printLn() drains for itself
+  uint32_t _logLastLoop;                // millis() of the last loop() drain, printLn() drains for itself once this goes stale
+  bool     _logFlushing;                // inside flush(), send what we have rather than wait for more
+  char     _syslogServer[64];           // syslog collector host name or address
+  IPAddress _syslogAddress;             // _syslogServer looked up, unset until it resolves
+  uint16_t _syslogPort;                 // from _syslogServer, or DEBUG_SYSLOG_PORT
+  WiFiUDP  _syslogUdp;
+  uint32_t _syslogWaitStart;            // millis() when the oldest unsent syslog text arrived, 0 if none waiting
+  uint8_t  _syslogTokens;               // datagrams we may send right now
+  uint32_t _syslogRefill;               // millis() of the last token refill
+  uint32_t _syslogSequence;             // RFC 5424 meta sequenceId of the last datagram
+  uint32_t _syslogSent;                 // datagrams sent
+  uint32_t _syslogDropped;              // bytes syslog lost, to the ring lapping it or a failed send
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _logAppend(const char *text, size_t length);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _logDrainAll(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _logDrain(sink_t sink, size_t room);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _logDrainLines(uint8_t maxLines);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _logDrainSyslog(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _syslogWrite(uint32_t from, uint32_t to);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline bool _logCaughtUp(void)
+  {
+    for (uint8_t sink = 0; sink < SINK_COUNT; sink++)
+    {
+      if (_logTail[sink] != _logHead) { return false; }
+    }
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _noteAppendMicros(uint32_t appendMicros) { if (appendMicros > _logAppendMaxMicros) { _logAppendMaxMicros = appendMicros; } }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _noteSyncMicros(uint32_t syncMicros) { if (syncMicros > _logSyncMaxMicros) { _logSyncMaxMicros = syncMicros; } }
 };
+
+// Logging front end for messages from a source_t. Source and verbosity are checked before any of
+// the arguments are evaluated, so a quiet source costs a test and a counter, not a String build.
+// Sources missing from DEBUG_COMPILED_SOURCES are a constant false and compile out altogether.
+//   DEBUG_PRINTLN(HMI, String(F("HMI OUT: ")) + cmd);
+#define DEBUG_SOURCE_COMPILED(source) ((DEBUG_COMPILED_SOURCES >> (source)) & 1)
+#define DEBUG_PRINTLN(source, ...)                                \
+  do                                                              \
+  {                                                               \
+    if (DEBUG_SOURCE_COMPILED(source) && debug.getVerbose(source)) \
+    {                                                             \
+      debug.printLn(__VA_ARGS__);                                 \
+    }                                                             \
+    else                                                          \
+    {                                                             \
+      debug.noteSkipped(source);                                  \
+    }                                                             \
+  } while (0)
@@ -14,6 +14,7 @@
 #include <ESP8266httpUpdate.h>
 #include <ArduinoOTA.h>
 #include <ArduinoJson.h>
+#include <FS.h>
 
 
 // TODO: Class These!
@@ -35,7 +36,7 @@ static void configSaveCallback()
 // Function implementing callback cannot itself be a class member
 static void configWiFiCallback(WiFiManager *myWiFiManager)
 { // Notify the user that we're entering config mode
-  debug.printLn(WIFI,F("WIFI: Failed to connect to assigned AP, entering config mode"));
+  DEBUG_PRINTLN(WIFI,F("WIFI: Failed to connect to assigned AP, entering config mode"));
   while (millis() < 800)
   { // for factory-reset system this will be called before display is responsive. give it a second.
     delay(10);
@@ -60,7 +61,11 @@ void ourEspClass::begin()
   // give internal variables initial values
   _motionPin = 0;
   _motionActive = false;
-  _updateCheckTimer = 0;
+  // The first check waits for the panel to report its version, then a random while more. A fleet that
+  // powers up together after an outage would otherwise all ask the update server at once.
+  // ESP.random() is the hardware RNG, random() isn't seeded and gives every plate the same numbers
+  _updateCheckTimer = millis();
+  _updateCheckWait = (NEXTION_RETRY_MAX * NEXTION_CHECK_INTERVAL) + (ESP.random() % UPDATE_CHECK_STARTUP_JITTER);
 
 #if UPDATE_CHECK_ENABLE==(false)
   config.setEspAvailable(false, HASP_VERSION);
@@ -93,9 +98,10 @@ void ourEspClass::loop()
   }
 
   // check internet for update (if enabled) and report about it over MQTT
-  if ((millis() - _updateCheckTimer) >= _updateCheckInterval)
+  if ((millis() - _updateCheckTimer) >= _updateCheckWait)
   { // Run periodic update check
     _updateCheckTimer = millis();
+    _updateCheckWait = _updateCheckInterval + (ESP.random() % UPDATE_CHECK_JITTER); // spread a fleet out so it doesn't all ask at the same time
     if (esp.updateCheck())
     { // Send a status update if the update check worked
       mqtt.statusUpdate();
@@ -107,8 +113,10 @@ void ourEspClass::loop()
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void ourEspClass::reset()
 {
+  trace.noteSoftReset();
   debug.printLn(F("RESET: HASP reset"));
   mqtt.goodbye();
+  debug.flush(); // get the last lines out of the log ring
   nextion.reset();
   ESP.reset();
   delay(5000);
@@ -167,7 +175,7 @@ void ourEspClass::wiFiSetup()
     // and goes into a blocking loop awaiting configuration.
     if (!wifiManager.autoConnect(_wifiConfigAP, _wifiConfigPass))
     { // Reset and try again
-      debug.printLn(WIFI,F("WIFI: Failed to connect and hit timeout"));
+      DEBUG_PRINTLN(WIFI,F("WIFI: Failed to connect and hit timeout"));
       reset();
     }
 
@@ -185,7 +193,7 @@ void ourEspClass::wiFiSetup()
   }
   else
   { // wifiSSID has been defined, so attempt to connect to it forever
-    debug.printLn(WIFI,String(F("Connecting to WiFi network: ")) + String(config.getWIFISSID()));
+    DEBUG_PRINTLN(WIFI,String(F("Connecting to WiFi network: ")) + String(config.getWIFISSID()));
     WiFi.mode(WIFI_STA);
     WiFi.begin(config.getWIFISSID(), config.getWIFIPass());
 
@@ -193,9 +201,10 @@ void ourEspClass::wiFiSetup()
     while (WiFi.status() != WL_CONNECTED)
     {
       delay(500);
+      debug.loop();
       if (millis() >= (wifiReconnectTimer + (_connectTimeout * ASECOND)))
       { // If we've been trying to reconnect for connectTimeout seconds, reboot and try again
-        debug.printLn(WIFI,F("WIFI: Failed to connect and hit timeout"));
+        DEBUG_PRINTLN(WIFI,F("WIFI: Failed to connect and hit timeout"));
         reset();
       }
     }
@@ -203,7 +212,8 @@ void ourEspClass::wiFiSetup()
   // If you get here you have connected to WiFi
   nextion.setAttr("p[0].b[1].font", "6");
   nextion.setAttr("p[0].b[1].txt", "\"WiFi Connected!\\r " + String(WiFi.SSID()) + "\\rIP: " + WiFi.localIP().toString() + "\"");
-  debug.printLn(WIFI,String(F("WIFI: Connected successfully and assigned IP: ")) + WiFi.localIP().toString());
+  DEBUG_PRINTLN(WIFI,String(F("WIFI: Connected successfully and assigned IP: ")) + WiFi.localIP().toString());
+  debug.resolveSyslogServer();
   if (nextion.getActivePage())
   {
     nextion.sendCmd("page " + String(nextion.getActivePage()));
@@ -214,7 +224,7 @@ void ourEspClass::wiFiSetup()
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void ourEspClass::wiFiReconnect()
 { // Existing WiFi connection dropped, try to reconnect
-  debug.printLn(WIFI,F("Reconnecting to WiFi network..."));
+  DEBUG_PRINTLN(WIFI,F("Reconnecting to WiFi network..."));
   WiFi.mode(WIFI_STA);
   WiFi.begin(config.getWIFISSID(), config.getWIFIPass());
 
@@ -222,12 +232,14 @@ void ourEspClass::wiFiReconnect()
   while (WiFi.status() != WL_CONNECTED)
   {
     delay(500);
+    debug.loop();
     if (millis() >= (wifiReconnectTimer + (_reConnectTimeout * ASECOND)))
     { // If we've been trying to reconnect for reConnectTimeout seconds, reboot and try again
-      debug.printLn(WIFI,F("WIFI: Failed to reconnect and hit timeout"));
+      DEBUG_PRINTLN(WIFI,F("WIFI: Failed to reconnect and hit timeout"));
       reset();
     }
   }
+  debug.resolveSyslogServer();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -279,24 +291,51 @@ void ourEspClass::startOta(String espOtaUrl)
   nextion.setAttr("p[0].b[1].txt", "\"HTTP update\\rstarting...\"");
   WiFiUDP::stopAll(); // Keep mDNS responder from breaking things
 
-  t_httpUpdate_return returnCode = ESPhttpUpdate.update(wifiClient, espOtaUrl);
-  switch (returnCode)
+  // Our own HTTPClient and Updater rather than ESPhttpUpdate.update(), so we can measure the download.
+  // Updater takes a gzipped image as it is, on a core that supports those (see ESP_OTA_GZIP_ENABLED)
+  debug.printLn(String(F("ESPFW: Attempting firmware download from: ")) + espOtaUrl);
+  HTTPClient espOtaHttp;
+  espOtaHttp.begin(wifiClient, espOtaUrl);
+  const char *espOtaHeaders[] = {"x-MD5"};
+  espOtaHttp.collectHeaders(espOtaHeaders, 1);
+  int espOtaHttpReturn = espOtaHttp.GET();
+  int32_t espOtaSize = espOtaHttp.getSize();
+  if (espOtaHttpReturn != HTTP_CODE_OK || espOtaSize <= 0)
   {
-  case HTTP_UPDATE_FAILED:
-    debug.printLn("ESPFW: HTTP_UPDATE_FAILED error " + String(ESPhttpUpdate.getLastError()) + " " + ESPhttpUpdate.getLastErrorString());
+    debug.printLn(String(F("ESPFW: HTTP GET failed, code ")) + String(espOtaHttpReturn) + String(F(" size ")) + String(espOtaSize));
+    nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rFAILED\"");
+  }
+  else if (!Update.begin(espOtaSize))
+  {
+    debug.printLn(String(F("ESPFW: Update.begin failed, error ")) + String(Update.getError()));
+    nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rFAILED\"");
+  }
+  else
+  {
+    if (espOtaHttp.header("x-MD5").length() == 32)
+    {
+      Update.setMD5(espOtaHttp.header("x-MD5").c_str());
+    }
+    uint32_t espOtaStart = millis();
+    size_t espOtaWritten = Update.writeStream(*espOtaHttp.getStreamPtr());
+    uint32_t espOtaTime = millis() - espOtaStart;
+    if (espOtaTime == 0)
+    {
+      espOtaTime = 1;
+    }
+    debug.printLn(String(F("ESPFW: downloaded ")) + String(espOtaWritten) + String(F(" of ")) + String(espOtaSize) + String(F(" bytes in ")) + String(espOtaTime) + String(F("ms, ")) + String((espOtaWritten * 1000ULL) / espOtaTime) + String(F(" bytes/s")));
+    if ((espOtaWritten == (size_t)espOtaSize) && Update.end())
+    {
+      espOtaHttp.end();
+      debug.printLn(F("ESPFW: HTTP_UPDATE_OK"));
+      nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rcomplete!\\r\\rRestarting.\"");
+      reset();
+    }
+    debug.printLn(String(F("ESPFW: HTTP_UPDATE_FAILED error ")) + String(Update.getError()));
+    Update.end(true); // throw away the partial image
     nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rFAILED\"");
-    break;
-
-  case HTTP_UPDATE_NO_UPDATES:
-    debug.printLn(F("ESPFW: HTTP_UPDATE_NO_UPDATES"));
-    nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rNo update\"");
-    break;
-
-  case HTTP_UPDATE_OK:
-    debug.printLn(F("ESPFW: HTTP_UPDATE_OK"));
-    nextion.setAttr("p[0].b[1].txt", "\"HTTP Update\\rcomplete!\\r\\rRestarting.\"");
-    reset();
   }
+  espOtaHttp.end();
   delay(5000);
   nextion.sendCmd("page " + String(nextion.getActivePage()));
 }
@@ -312,27 +351,63 @@ bool ourEspClass::updateCheck()
 #else
   HTTPClient updateClient;
   debug.printLn(String(F("UPDATE: Checking update URL: ")) + String(UPDATE_URL));
-  String updatePayload;
   updateClient.begin(wifiClient, UPDATE_URL);
+  updateClient.useHTTP10(true); // no chunked encoding, so the JSON can be parsed straight off the socket
+  const char *updateHeaders[] = {"ETag", "Last-Modified"};
+  updateClient.collectHeaders(updateHeaders, 2);
+
+  // The filtered version.json from the last check, with the validators the server sent for it
+  DynamicJsonDocument updateJson(UPDATE_JSON_SIZE);
+  bool updateCached = _updateCacheRead(updateJson);
+  if (updateCached)
+  {
+    if (updateJson[F("_etag")].as<String>().length() > 0)
+    {
+      updateClient.addHeader(F("If-None-Match"), updateJson[F("_etag")].as<String>());
+    }
+    if (updateJson[F("_modified")].as<String>().length() > 0)
+    {
+      updateClient.addHeader(F("If-Modified-Since"), updateJson[F("_modified")].as<String>());
+    }
+  }
   int httpCode = updateClient.GET(); // start connection and send HTTP header
+  DeserializationError jsonError;
 
-  if (httpCode > 0)
+  if (httpCode <= 0)
   { // httpCode will be negative on error
-    if (httpCode == HTTP_CODE_OK)
-    { // file found at server
-      updatePayload = updateClient.getString();
+    debug.printLn(String(F("UPDATE: Update check failed: ")) + updateClient.errorToString(httpCode));
+    return false;
+  }
+  else if ((httpCode == HTTP_CODE_NOT_MODIFIED) && updateCached)
+  { // nothing changed on the server, use what we kept
+    debug.printLn(F("UPDATE: version.json not modified"));
+  }
+  else if (httpCode == HTTP_CODE_OK)
+  { // file found at server. Only keep our own keys, whatever else the file grows to hold
+    StaticJsonDocument<128> updateFilter;
+    updateFilter[F("d1_mini")] = true;
+    if (nextion.getModel().length() > 0)
+    {
+      updateFilter[nextion.getModel()] = true;
+    }
+    updateJson.clear();
+    jsonError = deserializeJson(updateJson, updateClient.getStream(), DeserializationOption::Filter(updateFilter));
+    if (!jsonError)
+    {
+      updateJson[F("_etag")] = updateClient.header("ETag");
+      updateJson[F("_modified")] = updateClient.header("Last-Modified");
+      updateJson[F("_model")] = nextion.getModel();
+      _updateCacheWrite(updateJson);
     }
   }
   else
   {
-    debug.printLn(String(F("UPDATE: Update check failed: ")) + updateClient.errorToString(httpCode));
+    debug.printLn(String(F("UPDATE: Update check failed, HTTP code ")) + String(httpCode));
+    updateClient.end();
     return false;
   }
   updateClient.end();
 
-  DynamicJsonDocument updateJson(2048);
-  DeserializationError jsonError = deserializeJson(updateJson, updatePayload);
-
   if (jsonError)
   { // Couldn't parse the returned JSON, so bail
     debug.printLn(String(F("UPDATE: JSON parsing failed: ")) + String(jsonError.c_str()));
@@ -343,7 +418,16 @@ bool ourEspClass::updateCheck()
     if (!updateJson["d1_mini"]["version"].isNull())
     {
       float newVersion = updateJson["d1_mini"]["version"].as<float>();
-      config.setEspFirmwareUrl(updateJson["d1_mini"]["firmware"].as<String>());
+#if ESP_OTA_GZIP_ENABLED==(true)
+      if (!updateJson["d1_mini"]["firmwareGz"].isNull())
+      {
+        config.setEspFirmwareUrl(updateJson["d1_mini"]["firmwareGz"].as<String>());
+      }
+      else
+#endif
+      {
+        config.setEspFirmwareUrl(updateJson["d1_mini"]["firmware"].as<String>());
+      }
       if( newVersion > config.getHaspVersion())
       {
         config.setEspAvailable(true, newVersion);
@@ -377,6 +461,43 @@ bool ourEspClass::updateCheck()
 #endif
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool ourEspClass::_updateCacheRead(JsonDocument &updateJson)
+{ // Load the result of the last update check from UPDATE_CACHE_FILE
+  // Return: true if there is one, and it was taken with the panel model we have now
+  if (!SPIFFS.exists(UPDATE_CACHE_FILE))
+  {
+    return false;
+  }
+  File cacheFile = SPIFFS.open(UPDATE_CACHE_FILE, "r");
+  DeserializationError jsonError = deserializeJson(updateJson, cacheFile);
+  cacheFile.close();
+  if (jsonError || (updateJson[F("_model")].as<String>() != nextion.getModel()))
+  { // unreadable, or a different panel is fitted and its key wasn't kept. Ask for the whole file
+    updateJson.clear();
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ourEspClass::_updateCacheWrite(JsonDocument &updateJson)
+{ // Keep the filtered version.json and its validators for the next conditional request
+  if ((updateJson[F("_etag")].as<String>().length() == 0) && (updateJson[F("_modified")].as<String>().length() == 0))
+  { // the server gave us nothing to send back, so there is no point writing flash
+    SPIFFS.remove(UPDATE_CACHE_FILE);
+    return;
+  }
+  File cacheFile = SPIFFS.open(UPDATE_CACHE_FILE, "w");
+  if (!cacheFile)
+  {
+    debug.printLn(F("UPDATE: [ERROR] failed to open update cache for writing"));
+    return;
+  }
+  serializeJson(updateJson, cacheFile);
+  cacheFile.close();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void ourEspClass::motionSetup()
 { // Set up the motion sensor pin and code
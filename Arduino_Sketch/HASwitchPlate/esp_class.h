@@ -16,6 +16,7 @@
 #include "settings.h"
 #include <Arduino.h>
 #include <WiFiManager.h>
+#include <ArduinoJson.h>
 
 // so EspClass and espClass collide with existing classes. So we need something more unique
 // let us prefix "our", because that is oh-so original.
@@ -26,7 +27,7 @@ private:
 public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   // constructor
-  ourEspClass(void) { _alive = false; }
+  ourEspClass(void) { _alive = false; _loopMaxMicros = 0; }
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   // destructor
@@ -64,6 +65,10 @@ public:
 
   String getMacHex(void);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline void noteLoopMicros(uint32_t loopMicros) { if (loopMicros > _loopMaxMicros) { _loopMaxMicros = loopMicros; } }
+  inline uint32_t getLoopMaxMicros(void) { return _loopMaxMicros; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   uint8_t getMotionPin(void) { return _motionPin; }
 
@@ -90,8 +95,15 @@ protected:
   const uint32_t _reConnectTimeout    = RECONNECT_TIMEOUT;      // Timeout for WiFi reconnection attempts in seconds
   const uint32_t _updateCheckInterval = UPDATE_CHECK_INTERVAL;  // Time in msec between update checks (12 hours)
   uint32_t _updateCheckTimer;                                   // Timer for update check
+  uint32_t _updateCheckWait;                                    // msec from _updateCheckTimer to the next update check, jitter included
   uint8_t  _espMac[6];                                          // Byte array to store our MAC address
   uint8_t  _motionPin;                                          // GPIO input pin for motion sensor if connected and enabled
   bool     _motionActive;                                       // Motion is being detected
+  uint32_t _loopMaxMicros;                                      // Longest single pass of loop() in usec since boot
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _updateCacheRead(JsonDocument &updateJson);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _updateCacheWrite(JsonDocument &updateJson);
 };
@@ -13,6 +13,11 @@
 #include "common.h"
 #include <ArduinoJson.h>
 #include <ESP8266httpUpdate.h>
+#include <FS.h>
+#include <MD5Builder.h>
+
+// whmi-wri transfer rates to try, fastest first. All are rates the Nextion supports
+static const uint32_t lcdOtaBaudSteps[] = {921600, 512000, 256000, 115200};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void hmiNextionClass::begin(void)
@@ -22,11 +27,26 @@ void hmiNextionClass::begin(void)
   _checkTimer          = 0;
   _retryMax            = NEXTION_RETRY_MAX;
   _lcdConnected        = false;
-  _lcdVersionQueryFlag = false;
   _lcdVersion          = 0;
   _returnIndex         = 0;
   _activePage          = 0;
   _reportPage0         = NEXTION_REPORT_PAGE0;
+  _streamInterval      = NEXTION_STREAM_INTERVAL;
+  _otaBuffer[0]        = NULL;
+  _otaBuffer[1]        = NULL;
+  _otaActive           = false;
+  _otaResult           = false;
+  _otaAccepted         = 0;
+  _streamActive        = false;
+  _streamGetPending    = false;
+  _streamTimer         = 0;
+  _getReplyHead        = 0;
+  _getReplyCount       = 0;
+  for( int idx=0; idx<NEXTION_STREAM_MAX; idx++)
+  {
+    _streamPage[idx]=0xFF; // no objects stream until asked to
+    _streamButton[idx]=0xFF;
+  }
 
 #if NEXTION_CACHE_ENABLED==(true)
   // setting the cache up goes here too
@@ -66,21 +86,27 @@ void hmiNextionClass::loop(void)
     processInput();
   }
 
+  if (_getReplyCount > 0)
+  { // forget any get the panel never answered
+    _getReplyExpire();
+  }
+
+  if (_streamActive)
+  { // a streaming slider is held down
+    _pollStream();
+  }
+
   if ((_lcdVersion < 1) && (millis() <= (_retryMax * CheckInterval)))
   { // Attempt to connect to LCD panel to collect model and version info during startup
     _connect();
   }
   else if ((_lcdVersion > 0) && (millis() <= (_retryMax * CheckInterval)) && !_startupCompleteFlag)
-  { // We have LCD info, so trigger an update check + report
-    if (esp.updateCheck())
-    { // Send a status update if the update check worked
-      mqtt.statusUpdate();
-      _startupCompleteFlag = true;
-    }
+  { // We have LCD info, so report. The update check follows from esp.loop() after a random startup delay
+    mqtt.statusUpdate();
+    _startupCompleteFlag = true;
   }
   else if ((millis() > (_retryMax * CheckInterval)) && !_startupCompleteFlag)
-  { // We still don't have LCD info so go ahead and run the rest of the checks once at startup anyway
-    esp.updateCheck();
+  { // We still don't have LCD info so go ahead and report once at startup anyway
     mqtt.statusUpdate();
     _startupCompleteFlag = true;
   }
@@ -129,13 +155,62 @@ void hmiNextionClass::initResetPin()
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void hmiNextionClass::getAttr(String hmiAttribute)
+void hmiNextionClass::getAttr(String hmiAttribute, String replySubtopic)
 { // Get the value of a Nextion component attribute
   // This will only send the command to the panel requesting the attribute, the actual
-  // return of that value will be handled by processInput and placed into mqttGetSubtopic
+  // return of that value will be handled by processInput and published to replySubtopic
+  _getAttr(hmiAttribute, (replySubtopic == "") ? NEXTION_REPLY_STATE : NEXTION_REPLY_SUBTOPIC, replySubtopic);
+  DEBUG_PRINTLN(HMI,String(F("HMI OUT: 'get ")) + hmiAttribute + "'");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_getAttr(String hmiAttribute, nextionReply_t kind, String replySubtopic)
+{ // Every get goes out through here, so each reply that comes back can be matched to its asker
+  if (_getReplyCount >= NEXTION_GET_QUEUE)
+  { // full of gets that will never be answered, most likely the oldest
+    getReply_t lost;
+    _getReplyPop(lost);
+    DEBUG_PRINTLN(HMI,F("HMI: [WARNING] get reply queue full, dropped the oldest"));
+  }
+  getReply_t &reply = _getReply[(_getReplyHead + _getReplyCount) % NEXTION_GET_QUEUE];
+  reply.kind = kind;
+  reply.subtopic = replySubtopic;
+  reply.sentMillis = millis();
+  _getReplyCount++;
+
+  uint32_t writeStart = micros();
   Serial1.print("get " + hmiAttribute);
   Serial1.write(Suffix, sizeof(Suffix));
-  debug.printLn(HMI,String(F("HMI OUT: 'get ")) + hmiAttribute + "'");
+  latency.uartWritten(writeStart, _uartDrainMicros(), true);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_getReplyPop(getReply_t &reply)
+{ // Take the oldest waiting get, false if there isn't one
+  if (_getReplyCount == 0)
+  {
+    return false;
+  }
+  reply = _getReply[_getReplyHead];
+  _getReply[_getReplyHead].subtopic = ""; // don't hold the String until the slot comes round again
+  _getReplyHead = (_getReplyHead + 1) % NEXTION_GET_QUEUE;
+  _getReplyCount--;
+  if (reply.kind == NEXTION_REPLY_STREAM)
+  { // answered or given up on, either way the next poll may go
+    _streamGetPending = false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_getReplyExpire(void)
+{ // A get the panel never answered (not connected yet, or at the wrong speed) would otherwise take the
+  // next reply for itself. The panel answers in a few msec, so one this old is not coming
+  getReply_t lost;
+  while ((_getReplyCount > 0) && ((millis() - _getReply[_getReplyHead].sentMillis) > NEXTION_GET_TIMEOUT))
+  {
+    _getReplyPop(lost);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -186,28 +261,98 @@ void hmiNextionClass::sendCmd(String cmd)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void hmiNextionClass::parseJson(String &strPayload)
+int16_t hmiNextionClass::parseJson(String &strPayload)
 { // Parse an incoming JSON array into individual Nextion commands
-  if (strPayload.endsWith(",]"))
-  { // Trailing null array elements are an artifact of older Home Assistant automations and need to
-    // be removed before parsing by ArduinoJSON 6+
-    strPayload.remove(strPayload.length() - 2, 2);
-    strPayload.concat("]");
-  }
-  DynamicJsonDocument commands(mqtt.getMaxPacketSize() + 1024);
-  DeserializationError jsonError = deserializeJson(commands, strPayload);
-  if (jsonError)
-  { // Couldn't parse incoming JSON command
-    debug.printLn(HMI,String(F("MQTT: [ERROR] Failed to parse incoming JSON command with error: ")) + String(jsonError.c_str()));
+  // The array is walked one element at a time, so the heap only ever holds a document for one command
+  // rather than one for the whole array, which for a long /api/cmd body is more than a fragmented heap has.
+  // A first pass checks the layout, so a malformed array sends nothing
+  // Return: count of commands sent, or -1 if the JSON would not parse
+  const char *json = strPayload.c_str();
+  uint32_t length = strPayload.length();
+  int16_t cmdCount = 0;
+  for (uint8_t pass = 0; pass < 2; pass++)
+  {
+    uint32_t idx = 0;
+    while ((idx < length) && isspace(json[idx])) { idx++; }
+    if ((idx >= length) || (json[idx] != '['))
+    {
+      DEBUG_PRINTLN(HMI,String(F("MQTT: [ERROR] Failed to parse incoming JSON command, not an array")));
+      return -1;
+    }
+    idx++;
+    cmdCount = 0;
+    while (true)
+    {
+      while ((idx < length) && isspace(json[idx])) { idx++; }
+      if ((idx < length) && (json[idx] == ']'))
+      { // done. Also takes the trailing ",]" older Home Assistant automations leave behind
+        break;
+      }
+      uint32_t elementEnd = _jsonElementEnd(json, length, idx);
+      if (elementEnd == 0)
+      {
+        DEBUG_PRINTLN(HMI,String(F("MQTT: [ERROR] Failed to parse incoming JSON command at offset ")) + String(idx));
+        return -1;
+      }
+      if (pass == 1)
+      {
+        DynamicJsonDocument command(elementEnd - idx + 1); // room for the unescaped text
+        DeserializationError jsonError = deserializeJson(command, json + idx, elementEnd - idx);
+        if (jsonError)
+        { // Couldn't parse incoming JSON command
+          DEBUG_PRINTLN(HMI,String(F("MQTT: [ERROR] Failed to parse incoming JSON command with error: ")) + String(jsonError.c_str()));
+          return -1;
+        }
+        if (!command.isNull())
+        {
+          sendCmd(command.as<String>());
+          delayMicroseconds(500); // Larger JSON objects can take a while to run through over serial,
+        }                         // give the ESP and Nextion a moment to deal with life
+      }
+      if (json[idx] != 'n')
+      { // null elements are skipped, not counted
+        cmdCount++;
+      }
+      idx = elementEnd;
+      while ((idx < length) && isspace(json[idx])) { idx++; }
+      if ((idx < length) && (json[idx] == ','))
+      {
+        idx++;
+      }
+      else if ((idx >= length) || (json[idx] != ']'))
+      {
+        DEBUG_PRINTLN(HMI,String(F("MQTT: [ERROR] Failed to parse incoming JSON command, expected , or ] at offset ")) + String(idx));
+        return -1;
+      }
+    }
   }
-  else
+  return cmdCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t hmiNextionClass::_jsonElementEnd(const char *json, uint32_t length, uint32_t start)
+{ // A command is a quoted string, which may hold escaped quotes. null is tolerated. Anything else,
+  // nested arrays and objects included, is not a command and fails the whole array
+  if (json[start] == '"')
   {
-    for (uint8_t i = 0; i < commands.size(); i++)
+    for (uint32_t idx = start + 1; idx < length; idx++)
     {
-      sendCmd(commands[i]);
-      delayMicroseconds(500); // Larger JSON objects can take a while to run through over serial,
-    }                         // give the ESP and Nextion a moment to deal with life
+      if (json[idx] == '\\')
+      {
+        idx++; // skip whatever was escaped
+      }
+      else if (json[idx] == '"')
+      {
+        return idx + 1;
+      }
+    }
+    return 0;
   }
+  if (((length - start) >= 4) && (strncmp(&json[start], "null", 4) == 0))
+  {
+    return start + 4;
+  }
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -221,11 +366,21 @@ bool hmiNextionClass::handleInput()
   static int termByteCnt = 0;   // counter for our 3 consecutive 0xFFs
   static String hmiDebugMsg = "HMI IN: "; // assemble a string for debug output
 
-  if (Serial.available())
+  uint32_t waitingBytes = Serial.available();
+  if (waitingBytes)
   {
     _lcdConnected = true;
     uint8_t commandByte = Serial.read();
-    hmiDebugMsg += (" 0x" + String(commandByte, HEX));
+    if (_returnIndex == 0)
+    { // start of a frame, the clock for touch to MQTT starts here. Every byte behind this one took a
+      // byte time (10 bits) to arrive, so it has been waiting at least that long while loop() was busy
+      uint32_t baud = Serial.baudRate();
+      latency.touchStart((baud > 0) ? ((waitingBytes * 10000000UL) / baud) : 0);
+    }
+    if (DEBUG_SOURCE_COMPILED(HMI) && debug.getVerbose(HMI))
+    { // this runs per byte, only pay for the hex dump when it will be printed
+      hmiDebugMsg += (" 0x" + String(commandByte, HEX));
+    }
     // check to see if we have one of 3 consecutive 0xFF which indicates the end of a command
     if (commandByte == 0xFF)
     {
@@ -245,7 +400,8 @@ bool hmiNextionClass::handleInput()
   }
   if (commandComplete)
   {
-    debug.printLn(HMI, hmiDebugMsg);
+    trace.event(TRACE_UART_RX, _returnBuffer[0], _returnIndex);
+    DEBUG_PRINTLN(HMI, hmiDebugMsg);
     hmiDebugMsg = "HMI IN: ";
   }
   return commandComplete;
@@ -257,6 +413,13 @@ void hmiNextionClass::processInput()
   // Command reference: https://www.itead.cc/wiki/Nextion_Instruction_Set#Format_of_Device_Return_Data
   // tl;dr: command uint8_t, command data, 0xFF 0xFF 0xFF
 
+#if NEXTION_ACK_MODE==(true)
+  if ((_returnBuffer[0] <= 0x23) || (_returnBuffer[0] == 0x70) || (_returnBuffer[0] == 0x71))
+  { // with bkcmd=3 every command gets exactly one of these: a result code, or the value it asked for
+    latency.panelReply();
+  }
+#endif
+
   if (_returnBuffer[0] == 0x65)
   { // Handle incoming touch command
     // 0x65+Page ID+Component ID+TouchEvent+End
@@ -270,21 +433,35 @@ void hmiNextionClass::processInput()
 
     if (buttonAction == 0x01)
     {
-      debug.printLn(HMI, String(F("HMI IN: [Button ON] 'p[")) + page + "].b[" + buttonID + "]'");
+      DEBUG_PRINTLN(HMI, String(F("HMI IN: [Button ON] 'p[")) + page + "].b[" + buttonID + "]'");
 
-      mqtt.publishButtonEvent(page, buttonID, "ON");
+      if (mqtt.publishButtonEvent(page, buttonID, "ON"))
+      { // only presses that reached the broker count
+        latency.touchDone();
+      }
+      websocket.sendButton(page, buttonID, "ON");
       beep.playSound(500,100,1);
+
+      if (_isStreamed(_returnBuffer[1], _returnBuffer[2]))
+      { // start polling .val for as long as this object is held
+        _streamActive = true;
+        _streamActivePage = _returnBuffer[1];
+        _streamActiveButton = _returnBuffer[2];
+        _streamLastValue = -1;
+        _streamTimer = millis();
+      }
     }
     if (buttonAction == 0x00)
     {
-      debug.printLn(HMI, String(F("HMI IN: [Button OFF] 'p[")) + page + "].b[" + buttonID + "]'");
+      DEBUG_PRINTLN(HMI, String(F("HMI IN: [Button OFF] 'p[")) + page + "].b[" + buttonID + "]'");
       mqtt.publishButtonEvent(page, buttonID, "OFF");
+      websocket.sendButton(page, buttonID, "OFF");
+      _streamActive = false;
 
       // Now see if this object has a .val that might have been updated.  Works for sliders,
-      // two-state buttons, etc, throws a 0x1A error for normal buttons which we'll catch and ignore
-      _mqttGetSubtopic = "/p[" + page + "].b[" + buttonID + "].val";
-      _mqttGetSubtopicJSON = "p[" + page + "].b[" + buttonID + "].val";
-      getAttr("p[" + page + "].b[" + buttonID + "].val");
+      // two-state buttons, etc, throws a 0x1A error for normal buttons which we'll catch and ignore.
+      // A streaming poll still in flight is answered first, as the panel replies in order
+      getAttr("p[" + page + "].b[" + buttonID + "].val", "/p[" + page + "].b[" + buttonID + "].val");
     }
   }
   else if (_returnBuffer[0] == 0x66)
@@ -293,13 +470,14 @@ void hmiNextionClass::processInput()
     // Example: 0x66 0x02 0xFF 0xFF 0xFF
     // Meaning: page 2
     String page = String(_returnBuffer[1]);
-    debug.printLn(HMI, String(F("HMI IN: [sendme Page] '")) + page + "'");
+    DEBUG_PRINTLN(HMI, String(F("HMI IN: [sendme Page] '")) + page + "'");
     // if ((_activePage != page.toInt()) && ((page != "0") || _reportPage0))
     if ((page != "0") || _reportPage0)
     { // If we have a new page AND ( (it's not "0") OR (we've set the flag to report 0 anyway) )
       _activePage = page.toInt();
       _replayCmd();
       mqtt.publishStatePage(page);
+      websocket.sendPage(page);
     }
   }
   else if (_returnBuffer[0] == 0x67)
@@ -316,12 +494,12 @@ void hmiNextionClass::processInput()
     uint8_t TouchAction = _returnBuffer[5];
     if (TouchAction == 0x01)
     {
-      debug.printLn(HMI,String(F("HMI IN: [Touch ON] '")) + xyCoord + "'");
+      DEBUG_PRINTLN(HMI,String(F("HMI IN: [Touch ON] '")) + xyCoord + "'");
       mqtt.publishStateSubTopic(String(F("/touchOn")), xyCoord);
     }
     else if (TouchAction == 0x00)
     {
-      debug.printLn(HMI,String(F("HMI IN: [Touch OFF] '")) + xyCoord + "'");
+      DEBUG_PRINTLN(HMI,String(F("HMI IN: [Touch OFF] '")) + xyCoord + "'");
       mqtt.publishStateSubTopic(String(F("/touchOff")), xyCoord);
     }
   }
@@ -335,15 +513,15 @@ void hmiNextionClass::processInput()
     { // convert the payload into a string
       getString += (char)_returnBuffer[i];
     }
-    debug.printLn(HMI,String(F("HMI IN: [String Return] '")) + getString + "'");
-    if (_mqttGetSubtopic == "")
-    { // If there's no outstanding request for a value, publish to mqttStateTopic
-      mqtt.publishStateTopic(getString);
+    DEBUG_PRINTLN(HMI,String(F("HMI IN: [String Return] '")) + getString + "'");
+    getReply_t reply;
+    if (_getReplyPop(reply) && (reply.kind != NEXTION_REPLY_STATE) && (reply.subtopic != ""))
+    { // publish to the subtopic of the get this answers
+      mqtt.publishStateSubTopic(reply.subtopic, getString);
     }
     else
-    { // Otherwise, publish the to saved mqttGetSubtopic and then reset mqttGetSubtopic
-      mqtt.publishStateSubTopic(_mqttGetSubtopic, getString);
-      _mqttGetSubtopic = "";
+    { // If there's no outstanding request for a value, publish to mqttStateTopic
+      mqtt.publishStateTopic(getString);
     }
   }
   else if (_returnBuffer[0] == 0x71)
@@ -356,23 +534,33 @@ void hmiNextionClass::processInput()
     getInt = (getInt << 8) | _returnBuffer[2];
     getInt = (getInt << 8) | _returnBuffer[1];
     String getString = String(getInt);
-    debug.printLn(HMI,String(F("HMI IN: [Int Return] '")) + getString + "'");
+    DEBUG_PRINTLN(HMI,String(F("HMI IN: [Int Return] '")) + getString + "'");
 
-    if (_lcdVersionQueryFlag)
+    getReply_t reply;
+    if (!_getReplyPop(reply))
+    { // nobody asked, publish to mqttStateTopic
+      mqtt.publishStateTopic(getString);
+    }
+    else if (reply.kind == NEXTION_REPLY_VERSION)
     {
       _lcdVersion = getInt;
-      _lcdVersionQueryFlag = false;
-      debug.printLn(HMI,String(F("HMI IN: lcdVersion '")) + String(_lcdVersion) + "'");
+      DEBUG_PRINTLN(HMI,String(F("HMI IN: lcdVersion '")) + String(_lcdVersion) + "'");
+    }
+    else if (reply.kind == NEXTION_REPLY_STREAM)
+    { // reply to a streaming poll, publish only if it moved
+      if (int32_t(getInt) != _streamLastValue)
+      {
+        _streamLastValue = getInt;
+        mqtt.publishStateSubTopic(reply.subtopic, getString);
+      }
     }
-    else if (_mqttGetSubtopic == "")
+    else if (reply.kind == NEXTION_REPLY_SUBTOPIC)
     {
-      mqtt.publishStateTopic(getString);
+      mqtt.publishStateSubTopic(reply.subtopic, getString);
     }
-    // Otherwise, publish the to saved mqttGetSubtopic and then reset mqttGetSubtopic
     else
     {
-      mqtt.publishStateSubTopic(_mqttGetSubtopic, getString);
-      _mqttGetSubtopic = "";
+      mqtt.publishStateTopic(getString);
     }
   }
   else if (_returnBuffer[0] == 0x63 && _returnBuffer[1] == 0x6f && _returnBuffer[2] == 0x6d && _returnBuffer[3] == 0x6f && _returnBuffer[4] == 0x6b)
@@ -388,7 +576,10 @@ void hmiNextionClass::processInput()
         if (comokFieldCount == 2)
         {
           _model = comokField;
-          debug.printLn(HMI,String(F("HMI IN: NextionModel: ")) + _model);
+          DEBUG_PRINTLN(HMI,String(F("HMI IN: NextionModel: ")) + _model);
+#if NEXTION_ACK_MODE==(true)
+          sendCmd("bkcmd=3"); // answer every command, so MQTT commands can be timed to the panel
+#endif
         }
         comokFieldCount++;
         comokField = "";
@@ -404,8 +595,12 @@ void hmiNextionClass::processInput()
     // 0x1A+End
     // ERROR: Variable name invalid
     // We'll be triggering this a lot due to requesting .val on every component that sends us a Touch Off
-    // Just reset mqttGetSubtopic and move on with life.
-    _mqttGetSubtopic = "";
+    // Just drop the get it answers and move on with life.
+    getReply_t reply;
+    if (_getReplyPop(reply) && (reply.kind == NEXTION_REPLY_STREAM))
+    { // our streaming poll was answered with an error, so this object has no .val. Stop polling it
+      _streamActive = false;
+    }
   }
   _returnIndex = 0; // Done handling the buffer, reset index back to 0
 }
@@ -417,18 +612,13 @@ void hmiNextionClass::startOtaDownload(String otaUrl)
   // http://support.iteadstudio.com/support/discussions/topics/11000007686/page/2
 
   uint32_t lcdOtaFileSize = 0;
-  String lcdOtaNextionCmd;
-  uint32_t lcdOtaChunkCounter = 0;
-  uint16_t lcdOtaPartNum = 0;
-  uint32_t lcdOtaTransferred = 0;
-  uint8_t lcdOtaPercentComplete = 0;
-  const uint32_t lcdOtaTimeout = 30000; // timeout for receiving new data in milliseconds
-  static uint32_t lcdOtaTimer = 0;      // timer for upload timeout
 
   debug.printLn(String(F("LCD OTA: Attempting firmware download from: ")) + otaUrl);
   WiFiClient lcdOtaWifi;
   HTTPClient lcdOtaHttp;
   lcdOtaHttp.begin(lcdOtaWifi, otaUrl);
+  const char *lcdOtaHeaders[] = {"x-MD5"};
+  lcdOtaHttp.collectHeaders(lcdOtaHeaders, 1);
   int lcdOtaHttpReturn = lcdOtaHttp.GET();
   if (lcdOtaHttpReturn > 0)
   { // HTTP header has been sent and Server response header has been handled
@@ -436,109 +626,97 @@ void hmiNextionClass::startOtaDownload(String otaUrl)
     if (lcdOtaHttpReturn == HTTP_CODE_OK)
     {                                                 // file found at server
       int32_t lcdOtaRemaining = lcdOtaHttp.getSize(); // get length of document (is -1 when Server sends no Content-Length header)
+      if (lcdOtaRemaining <= 0)
+      { // the panel must be told the size up front
+        debug.printLn(F("LCD OTA: Server did not send a Content-Length, cannot update."));
+        lcdOtaHttp.end();
+        return;
+      }
       lcdOtaFileSize = lcdOtaRemaining;
-      static uint16_t lcdOtaParts = (lcdOtaRemaining / 4096) + 1;
-      static const uint16_t lcdOtaBufferSize = 1024; // upload data buffer before sending to UART
-      static uint8_t lcdOtaBuffer[lcdOtaBufferSize] = {};
+      uint16_t lcdOtaParts = (lcdOtaRemaining / 4096) + 1;
 
       debug.printLn(String(F("LCD OTA: File found at Server. Size ")) + String(lcdOtaRemaining) + String(F(" bytes in ")) + String(lcdOtaParts) + String(F(" 4k chunks.")));
 
-      WiFiUDP::stopAll(); // Keep mDNS responder and MQTT traffic from breaking things
-      if (mqtt.clientIsConnected())
-      {
-        debug.printLn(F("LCD OTA: LCD firmware upload starting, closing MQTT connection."));
-        mqtt.goodbye();
-      }
+      WiFiUDP::stopAll(); // Keep mDNS responder from breaking things
+      // MQTT stays connected to carry progress. mqtt.loop() doesn't run again before we reset,
+      // so no incoming command can reach the panel mid-upload, and esp.reset() says goodbye
 
       WiFiClient *stream = lcdOtaHttp.getStreamPtr();      // get tcp stream
-      Serial1.write(Suffix, sizeof(Suffix)); // Send empty command
-      Serial1.flush();
-      handleInput();
-      String lcdOtaNextionCmd = "whmi-wri " + String(lcdOtaFileSize) + ",115200,0";
-      debug.printLn(String(F("LCD OTA: Sending LCD upload command: ")) + lcdOtaNextionCmd);
-      Serial1.print(lcdOtaNextionCmd);
-      Serial1.write(Suffix, sizeof(Suffix));
-      Serial1.flush();
-
-      if (otaResponse())
-      {
-        debug.printLn(F("LCD OTA: LCD upload command accepted."));
-      }
-      else
-      {
-        debug.printLn(F("LCD OTA: LCD upload command FAILED.  Restarting device."));
-        esp.reset();
-      }
-      debug.printLn(F("LCD OTA: Starting update"));
-      lcdOtaTimer = millis();
-      while (lcdOtaHttp.connected() && (lcdOtaRemaining > 0 || lcdOtaRemaining == -1))
-      {                                                // Write incoming data to panel as it arrives
-        uint16_t lcdOtaHttpSize = stream->available(); // get available data size
-
-        if (lcdOtaHttpSize)
+#if NEXTION_OTA_STAGE_ENABLED==(true)
+      if (_otaStageHasRoom(lcdOtaFileSize))
+      { // Download and verify the whole TFT before the panel is touched, so a WiFi stall can't brick it
+        bool lcdOtaStaged = _otaStage(*stream, lcdOtaFileSize, lcdOtaHttp.header("x-MD5"));
+        lcdOtaHttp.end();
+        if (!lcdOtaStaged)
         {
-          uint16_t lcdOtaChunkSize = 0;
-          if ((lcdOtaHttpSize <= lcdOtaBufferSize) && (lcdOtaHttpSize <= (4096 - lcdOtaChunkCounter)))
-          {
-            lcdOtaChunkSize = lcdOtaHttpSize;
-          }
-          else if ((lcdOtaBufferSize <= lcdOtaHttpSize) && (lcdOtaBufferSize <= (4096 - lcdOtaChunkCounter)))
-          {
-            lcdOtaChunkSize = lcdOtaBufferSize;
-          }
-          else
-          {
-            lcdOtaChunkSize = 4096 - lcdOtaChunkCounter;
-          }
-          stream->readBytes(lcdOtaBuffer, lcdOtaChunkSize);
-          Serial1.flush();                              // make sure any previous writes the UART have completed
-          Serial1.write(lcdOtaBuffer, lcdOtaChunkSize); // now send buffer to the UART
-          lcdOtaChunkCounter += lcdOtaChunkSize;
-          if (lcdOtaChunkCounter >= 4096)
+          SPIFFS.remove(NEXTION_OTA_STAGE_FILE);
+          debug.printLn(F("LCD OTA: Staging failed, panel left untouched.  Restarting device."));
+          esp.reset();
+        }
+        File lcdOtaStageFile = SPIFFS.open(NEXTION_OTA_STAGE_FILE, "r");
+        uint32_t lcdOtaMaxBaud = NEXTION_OTA_MAX_BAUD;
+        bool lcdOtaResult = false;
+        while (true)
+        { // A rate the panel ACKs can still be too fast for the wiring. The file can be read again, so a
+          // transfer that fails in its first parts starts over one rate lower rather than giving up
+          if (!otaBegin(lcdOtaFileSize, lcdOtaMaxBaud))
           {
-            Serial1.flush();
-            lcdOtaPartNum++;
-            lcdOtaTransferred += lcdOtaChunkCounter;
-            lcdOtaPercentComplete = (lcdOtaTransferred * 100) / lcdOtaFileSize;
-            lcdOtaChunkCounter = 0;
-            if (otaResponse())
-            { // We've completed a chunk
-              debug.printLn(String(F("LCD OTA: Part ")) + String(lcdOtaPartNum) + String(F(" OK, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
-              lcdOtaTimer = millis();
-            }
-            else
-            {
-              debug.printLn(String(F("LCD OTA: Part ")) + String(lcdOtaPartNum) + String(F(" FAILED, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
-              debug.printLn(F("LCD OTA: failure"));
-              delay(2000); // extra delay while the LCD does its thing
-              esp.reset();
-            }
+            lcdOtaStageFile.close();
+            SPIFFS.remove(NEXTION_OTA_STAGE_FILE);
+            debug.printLn(F("LCD OTA: LCD upload command FAILED.  Restarting device."));
+            esp.reset();
           }
-          else
+          debug.printLn(F("LCD OTA: Starting update from local flash"));
+          lcdOtaStageFile.seek(0);
+          lcdOtaResult = otaStream(lcdOtaStageFile, lcdOtaFileSize) && otaEnd();
+          uint32_t lcdOtaFailedBaud = _otaBaud;
+          bool lcdOtaEarly = (_otaPartNum <= NEXTION_OTA_RESTART_PARTS);
+          otaAbort(); // logs the attempt if otaEnd() never ran
+          if (lcdOtaResult || !lcdOtaEarly || (lcdOtaFailedBaud <= NEXTION_BAUD))
           {
-            delay(20);
+            break;
           }
-          if (lcdOtaRemaining > 0)
-          {
-            lcdOtaRemaining -= lcdOtaChunkSize;
+          debug.printLn(String(F("LCD OTA: failed early at ")) + String(lcdOtaFailedBaud) + String(F(" baud, restarting the panel to try a lower rate")));
+          lcdOtaMaxBaud = lcdOtaFailedBaud - 1;
+          _otaPanelRestart();
+        }
+        lcdOtaStageFile.close();
+        SPIFFS.remove(NEXTION_OTA_STAGE_FILE);
+        if (lcdOtaResult)
+        {
+          debug.printLn(String(F("LCD OTA: Success, wrote ")) + String(lcdOtaFileSize) + " bytes.");
+          uint32_t lcdOtaDelay = millis();
+          while ((millis() - lcdOtaDelay) < 5000)
+          { // extra 5sec delay while the LCD handles any local firmware updates from new versions of code sent to it
+            web.loop();
+            debug.loop();
+            delay(1);
           }
         }
-        delay(10);
-        if ((lcdOtaTimer > 0) && ((millis() - lcdOtaTimer) > lcdOtaTimeout))
-        { // Our timer expired so reset
-          debug.printLn(F("LCD OTA: ERROR: LCD upload timeout.  Restarting."));
-          esp.reset();
+        else
+        {
+          debug.printLn(F("LCD OTA: Failure"));
+          delay(2000); // extra delay while the LCD does its thing
         }
+        esp.reset();
       }
-      lcdOtaPartNum++;
-      lcdOtaTransferred += lcdOtaChunkCounter;
-      if ((lcdOtaTransferred == lcdOtaFileSize) && otaResponse())
+#endif
+      if (!otaBegin(lcdOtaFileSize))
+      {
+        debug.printLn(F("LCD OTA: LCD upload command FAILED.  Restarting device."));
+        esp.reset();
+      }
+      debug.printLn(F("LCD OTA: Starting update"));
+      bool lcdOtaResult = otaStream(*stream, lcdOtaFileSize) && otaEnd();
+      otaAbort(); // logs the attempt if otaEnd() never ran. A network stream can't be read again to retry slower
+      if (lcdOtaResult)
       {
-        debug.printLn(String(F("LCD OTA: Success, wrote ")) + String(lcdOtaTransferred) + " of " + String(web.getTftFileSize()) + " bytes.");
+        debug.printLn(String(F("LCD OTA: Success, wrote ")) + String(lcdOtaFileSize) + " bytes.");
         uint32_t lcdOtaDelay = millis();
         while ((millis() - lcdOtaDelay) < 5000)
         { // extra 5sec delay while the LCD handles any local firmware updates from new versions of code sent to it
           web.loop();
+          debug.loop();
           delay(1);
         }
         esp.reset();
@@ -546,6 +724,7 @@ void hmiNextionClass::startOtaDownload(String otaUrl)
       else
       {
         debug.printLn(F("LCD OTA: Failure"));
+        delay(2000); // extra delay while the LCD does its thing
         esp.reset();
       }
     }
@@ -558,6 +737,506 @@ void hmiNextionClass::startOtaDownload(String otaUrl)
   lcdOtaHttp.end();
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::otaBegin(uint32_t fileSize, uint32_t maxBaud)
+{ // Put the panel into upload mode at the fastest rate up to maxBaud it takes, and set up the double buffers
+  // Return: true if the panel accepted the upload command
+  _otaFree();
+  _otaBuffer[0] = (uint8_t *)malloc(NEXTION_OTA_BUFFER_SIZE);
+  _otaBuffer[1] = (uint8_t *)malloc(NEXTION_OTA_BUFFER_SIZE);
+  if (_otaBuffer[0] == NULL || _otaBuffer[1] == NULL)
+  {
+    DEBUG_PRINTLN(HMI, F("LCD OTA: [ERROR] no heap for transfer buffers"));
+    _otaFree();
+    return false;
+  }
+  _otaFill[0] = 0;
+  _otaFill[1] = 0;
+  _otaTxIndex = 0;
+  _otaTxOffset = 0;
+  _otaPartSent = 0;
+  _otaPartNum = 0;
+  _otaFileSize = fileSize;
+  _otaAccepted = 0;
+  _otaTransferred = 0;
+  _otaResult = false;
+  _otaBaud = 0;
+
+  for (uint8_t baudIdx = 0; baudIdx < (sizeof(lcdOtaBaudSteps) / sizeof(lcdOtaBaudSteps[0])); baudIdx++)
+  { // ask for the fastest rate first, and step down one rate at a time until the panel ACKs
+    uint32_t otaBaud = lcdOtaBaudSteps[baudIdx];
+    if (otaBaud > maxBaud)
+    {
+      continue;
+    }
+    Serial1.write(Suffix, sizeof(Suffix)); // Send empty command to LCD
+    Serial1.flush();
+    handleInput();
+
+    String lcdOtaNextionCmd = "whmi-wri " + String(fileSize) + "," + String(otaBaud) + ",0";
+    debug.printLn(String(F("LCD OTA: Sending LCD upload command: ")) + lcdOtaNextionCmd);
+    Serial1.print(lcdOtaNextionCmd);
+    Serial1.write(Suffix, sizeof(Suffix));
+    Serial1.flush();
+    _otaSetBaud(otaBaud); // the panel answers at the new rate
+
+    if (otaResponse())
+    {
+      _otaBaud = otaBaud;
+      break;
+    }
+    _otaSetBaud(NEXTION_BAUD);
+    debug.printLn(String(F("LCD OTA: no ACK at ")) + String(otaBaud) + String(F(" baud, 0 bytes/s, stepping down")));
+    delay(NEXTION_OTA_BAUD_SETTLE); // let the panel give up on the rate it did not manage
+  }
+  if (_otaBaud == 0)
+  {
+    _otaFree();
+    return false;
+  }
+  debug.printLn(String(F("LCD OTA: transfer at ")) + String(_otaBaud) + String(F(" baud")));
+  debug.printLn(F("LCD OTA: LCD upload command accepted"));
+  _otaActive = true;
+  _otaStartTime = millis();
+  _otaAckMillis = 0;
+  _otaAckMaxMillis = 0;
+  _otaProgress(F("started"), true);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::otaWrite(const uint8_t *data, size_t length)
+{ // Accept a block of TFT data (an HTTP upload packet). Everything is copied before we return,
+  // what the UART has not taken yet keeps draining on the next call
+  // Return: false if the panel did not ACK a part
+  if (!_otaActive)
+  {
+    return false;
+  }
+  while (length > 0)
+  {
+    uint8_t fillIndex = _otaTxIndex ^ 1;
+    uint16_t room = NEXTION_OTA_BUFFER_SIZE - _otaFill[fillIndex];
+    if (room == 0)
+    { // both buffers full, let the UART catch up
+      if (!_otaPump(false))
+      {
+        return false;
+      }
+      yield();
+      continue;
+    }
+    uint16_t copySize = (length < room) ? length : room;
+    memcpy(&_otaBuffer[fillIndex][_otaFill[fillIndex]], data, copySize);
+    _otaFill[fillIndex] += copySize;
+    _otaAccepted += copySize;
+    data += copySize;
+    length -= copySize;
+    if (!_otaPump(false))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::otaStream(Client &source, uint32_t length)
+{ // Pull length bytes from the network into the panel, reading while the UART drains
+  // Return: false on a missed ACK, a dropped connection or NEXTION_OTA_TIMEOUT without data
+  return _otaStreamFrom(source, length, &source);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::otaStream(File &source, uint32_t length)
+{ // Pull length bytes of a staged TFT from local flash into the panel
+  // Return: false on a missed ACK or a short file
+  return _otaStreamFrom(source, length, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_otaStreamFrom(Stream &source, uint32_t length, Client *connection)
+{ // Shared by both otaStream()s. connection is NULL for a local file, which never waits for data
+  uint32_t lcdOtaTimer = millis();
+  while (_otaAccepted < length)
+  {
+    uint8_t fillIndex = _otaTxIndex ^ 1;
+    uint16_t room = NEXTION_OTA_BUFFER_SIZE - _otaFill[fillIndex];
+    size_t available = source.available();
+    if (room > 0 && available > 0)
+    {
+      size_t readSize = room;
+      if (readSize > available)
+      {
+        readSize = available;
+      }
+      if (readSize > (length - _otaAccepted))
+      {
+        readSize = length - _otaAccepted;
+      }
+      readSize = source.read(&_otaBuffer[fillIndex][_otaFill[fillIndex]], readSize);
+      _otaFill[fillIndex] += readSize;
+      _otaAccepted += readSize;
+      lcdOtaTimer = millis();
+    }
+    else if (available == 0 && connection == NULL)
+    {
+      debug.printLn(F("LCD OTA: ERROR: staged file is short."));
+      _otaProgress(F("failed"), true);
+      return false;
+    }
+    else if (available == 0 && !connection->connected())
+    {
+      debug.printLn(F("LCD OTA: ERROR: connection closed early."));
+      _otaProgress(F("failed"), true);
+      return false;
+    }
+    if (!_otaPump(false))
+    {
+      return false;
+    }
+    if ((millis() - lcdOtaTimer) > NEXTION_OTA_TIMEOUT)
+    {
+      debug.printLn(F("LCD OTA: ERROR: LCD download timeout."));
+      _otaProgress(F("failed"), true);
+      return false;
+    }
+    yield();
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_otaStageHasRoom(uint32_t length)
+{ // Is there space in SPIFFS to hold a TFT of this size? Needs a filesystem in the ldscript (eagle.flash.4m2m.ld, 4m3m)
+  // Return: true if staging should be used
+  FSInfo stageInfo;
+  SPIFFS.remove(NEXTION_OTA_STAGE_FILE); // a leftover from an interrupted update doesn't count against us
+  if (!SPIFFS.info(stageInfo))
+  {
+    debug.printLn(F("LCD OTA: no filesystem, streaming straight to the panel"));
+    return false;
+  }
+  uint32_t stageFree = stageInfo.totalBytes - stageInfo.usedBytes;
+  if (stageFree < (length + NEXTION_OTA_STAGE_RESERVE))
+  {
+    debug.printLn(String(F("LCD OTA: only ")) + String(stageFree) + String(F(" bytes free in flash, streaming straight to the panel")));
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_otaStage(Client &source, uint32_t length, const String &expectedMd5)
+{ // Download the TFT into NEXTION_OTA_STAGE_FILE, then read it back to check size and MD5
+  // expectedMd5 is the server's x-MD5 header, may be empty
+  // Return: true if the staged file is complete and verified
+  File stageFile = SPIFFS.open(NEXTION_OTA_STAGE_FILE, "w");
+  if (!stageFile)
+  {
+    debug.printLn(F("LCD OTA: ERROR: cannot create staging file"));
+    return false;
+  }
+  uint8_t *stageBuffer = (uint8_t *)malloc(NEXTION_OTA_BUFFER_SIZE);
+  if (stageBuffer == NULL)
+  {
+    DEBUG_PRINTLN(HMI, F("LCD OTA: [ERROR] no heap for staging buffer"));
+    stageFile.close();
+    return false;
+  }
+  MD5Builder downloadMd5;
+  downloadMd5.begin();
+  uint32_t stageWritten = 0;
+  uint32_t stageStart = millis();
+  uint32_t stageTimer = stageStart;
+  bool stageResult = true;
+  debug.printLn(String(F("LCD OTA: Staging ")) + String(length) + String(F(" bytes to ")) + String(F(NEXTION_OTA_STAGE_FILE)));
+  while (stageWritten < length)
+  {
+    size_t available = source.available();
+    if (available > 0)
+    {
+      size_t readSize = NEXTION_OTA_BUFFER_SIZE;
+      if (readSize > available)
+      {
+        readSize = available;
+      }
+      if (readSize > (length - stageWritten))
+      {
+        readSize = length - stageWritten;
+      }
+      readSize = source.read(stageBuffer, readSize);
+      downloadMd5.add(stageBuffer, readSize);
+      if (stageFile.write(stageBuffer, readSize) != readSize)
+      {
+        debug.printLn(F("LCD OTA: ERROR: flash write failed"));
+        stageResult = false;
+        break;
+      }
+      stageWritten += readSize;
+      stageTimer = millis();
+    }
+    else if (!source.connected())
+    {
+      debug.printLn(F("LCD OTA: ERROR: connection closed early."));
+      stageResult = false;
+      break;
+    }
+    else if ((millis() - stageTimer) > NEXTION_OTA_TIMEOUT)
+    {
+      debug.printLn(F("LCD OTA: ERROR: LCD download timeout."));
+      stageResult = false;
+      break;
+    }
+    yield();
+  }
+  stageFile.close();
+  if (!stageResult)
+  {
+    free(stageBuffer);
+    return false;
+  }
+  uint32_t stageTime = millis() - stageStart;
+  if (stageTime == 0)
+  {
+    stageTime = 1;
+  }
+  downloadMd5.calculate();
+  debug.printLn(String(F("LCD OTA: staged ")) + String(stageWritten) + String(F(" bytes in ")) + String(stageTime) + String(F("ms, MD5 ")) + downloadMd5.toString());
+
+  if ((expectedMd5.length() > 0) && !expectedMd5.equalsIgnoreCase(downloadMd5.toString()))
+  {
+    debug.printLn(String(F("LCD OTA: ERROR: MD5 mismatch, server sent ")) + expectedMd5);
+    free(stageBuffer);
+    return false;
+  }
+
+  // read it back, what we send the panel is what is in flash, not what came off the network
+  MD5Builder stagedMd5;
+  stagedMd5.begin();
+  stageFile = SPIFFS.open(NEXTION_OTA_STAGE_FILE, "r");
+  if (!stageFile || (stageFile.size() != length))
+  {
+    debug.printLn(F("LCD OTA: ERROR: staged file has the wrong size"));
+    stageFile.close();
+    free(stageBuffer);
+    return false;
+  }
+  while (stageFile.available())
+  {
+    size_t readSize = stageFile.read(stageBuffer, NEXTION_OTA_BUFFER_SIZE);
+    stagedMd5.add(stageBuffer, readSize);
+    yield();
+  }
+  stageFile.close();
+  free(stageBuffer);
+  stagedMd5.calculate();
+  if (!stagedMd5.toString().equals(downloadMd5.toString()))
+  {
+    debug.printLn(String(F("LCD OTA: ERROR: staged file reads back as MD5 ")) + stagedMd5.toString());
+    return false;
+  }
+  debug.printLn(F("LCD OTA: staged file verified"));
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::otaEnd()
+{ // Drain what is left and collect the final ACK. Safe to call more than once
+  if (!_otaActive)
+  {
+    return _otaResult;
+  }
+  _otaResult = _otaPump(true);
+  if (_otaResult && _otaPartSent > 0)
+  { // a short last part gets its own ACK. A file that is an exact multiple of 4096 was ACKed in the pump
+    Serial1.flush();
+    _otaResult = otaResponse();
+    if (!_otaResult)
+    {
+      _otaProgress(F("failed"), true);
+    }
+  }
+  if (_otaResult)
+  {
+    _otaProgress(F("done"), true);
+  }
+  _otaLogRate(_otaResult ? F("done") : F("failed"));
+  _otaFree();
+  return _otaResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::otaAbort()
+{ // Give up on a transfer that failed before otaEnd(), so its throughput is logged all the same
+  if (!_otaActive)
+  {
+    return;
+  }
+  _otaLogRate(F("failed"));
+  _otaFree();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_otaLogRate(const __FlashStringHelper *outcome)
+{ // One line per attempt, so rates can be compared on the wiring at hand
+  uint32_t otaTime = millis() - _otaStartTime;
+  if (otaTime == 0)
+  {
+    otaTime = 1;
+  }
+  uint32_t otaRate = (_otaTransferred * 1000ULL) / otaTime;
+  debug.printLn(String(F("LCD OTA: ")) + String(outcome) + String(F(", wrote ")) + String(_otaTransferred) + String(F(" of ")) + String(_otaFileSize) + String(F(" bytes in ")) + String(otaTime) + String(F("ms at ")) + String(_otaBaud) + String(F(" baud, ")) + String(otaRate) + String(F(" bytes/s, ")) + String((otaRate * 1000ULL) / _otaBaud) + String(F("% of line rate")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_otaPanelRestart()
+{ // Power the panel off and on to get it out of upload mode, and wait for it to come back at its own rate
+  digitalWrite(_resetPin, LOW);
+  delay(100);
+  digitalWrite(_resetPin, HIGH);
+  uint32_t restartTimer = millis();
+  _lcdConnected = false;
+  while (!_lcdConnected && ((millis() - restartTimer) < 5000))
+  {
+    handleInput();
+    yield();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_otaPump(bool drainAll)
+{ // Write to the UART only what its FIFO will take right now, stopping at each 4096 byte part
+  // boundary to wait for the panel's 0x05. With drainAll, keep going until both buffers are empty
+  // Return: false if a part was not ACKed
+  while (true)
+  {
+    if (_otaTxOffset >= _otaFill[_otaTxIndex])
+    { // draining buffer is empty, swap to the full one if it has anything
+      _otaFill[_otaTxIndex] = 0;
+      _otaTxOffset = 0;
+      if (_otaFill[_otaTxIndex ^ 1] == 0)
+      {
+        return true; // nothing left to send
+      }
+      _otaTxIndex ^= 1;
+    }
+
+    uint32_t writeSize = _otaFill[_otaTxIndex] - _otaTxOffset;
+    if (writeSize > (4096 - _otaPartSent))
+    {
+      writeSize = 4096 - _otaPartSent;
+    }
+    uint32_t uartRoom = Serial1.availableForWrite();
+    if (writeSize > uartRoom)
+    {
+      writeSize = uartRoom;
+    }
+    if (writeSize == 0)
+    {
+      if (!drainAll)
+      {
+        return true; // UART is busy, come back after the next network read
+      }
+      yield();
+      continue;
+    }
+    Serial1.write(&_otaBuffer[_otaTxIndex][_otaTxOffset], writeSize);
+    _otaTxOffset += writeSize;
+    _otaPartSent += writeSize;
+    _otaTransferred += writeSize;
+
+    if (_otaPartSent >= 4096)
+    { // end of a part, the panel must ACK before it will take more
+      Serial1.flush();
+      _otaPartSent = 0;
+      _otaPartNum++;
+      uint8_t lcdOtaPercentComplete = (_otaTransferred * 100ULL) / _otaFileSize;
+      uint32_t lcdOtaAckStart = millis();
+      bool lcdOtaAcked = otaResponse();
+      _otaAckMillis = millis() - lcdOtaAckStart;
+      if (_otaAckMillis > _otaAckMaxMillis)
+      {
+        _otaAckMaxMillis = _otaAckMillis;
+      }
+      if (!lcdOtaAcked)
+      {
+        debug.printLn(String(F("LCD OTA: Part ")) + String(_otaPartNum) + String(F(" FAILED, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
+        _otaResult = false;
+        _otaProgress(F("failed"), true);
+        return false;
+      }
+      DEBUG_PRINTLN(HMI, String(F("LCD OTA: Part ")) + String(_otaPartNum) + String(F(" OK, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
+      _otaProgress(F("flashing"), false);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_otaProgress(const __FlashStringHelper *state, bool force)
+{ // Publish where the transfer is up to, at most once every NEXTION_OTA_PROGRESS_INTERVAL unless forced
+  if (!force && ((millis() - _otaProgressTimer) < NEXTION_OTA_PROGRESS_INTERVAL))
+  {
+    return;
+  }
+  _otaProgressTimer = millis();
+  uint32_t otaTime = millis() - _otaStartTime;
+  if (otaTime == 0)
+  {
+    otaTime = 1;
+  }
+  uint32_t otaRate = (_otaTransferred * 1000ULL) / otaTime;
+  uint32_t otaEta = 0;
+  if (otaRate > 0)
+  {
+    otaEta = (_otaFileSize - _otaTransferred) / otaRate;
+  }
+  uint32_t otaPercent = 0;
+  if (_otaFileSize > 0)
+  {
+    otaPercent = (_otaTransferred * 100ULL) / _otaFileSize;
+  }
+  String progressPayload = String(F("{\"state\":\"")) + String(state) + String(F("\","));
+  progressPayload += String(F("\"bytes\":")) + String(_otaTransferred) + String(F(","));
+  progressPayload += String(F("\"size\":")) + String(_otaFileSize) + String(F(","));
+  progressPayload += String(F("\"percent\":")) + String(otaPercent) + String(F(","));
+  progressPayload += String(F("\"part\":")) + String(_otaPartNum) + String(F(","));
+  progressPayload += String(F("\"ackMs\":")) + String(_otaAckMillis) + String(F(","));
+  progressPayload += String(F("\"ackMaxMs\":")) + String(_otaAckMaxMillis) + String(F(","));
+  progressPayload += String(F("\"bytesPerSec\":")) + String(otaRate) + String(F(","));
+  progressPayload += String(F("\"etaSec\":")) + String(otaEta) + String(F(","));
+  progressPayload += String(F("\"baud\":")) + String(_otaBaud) + String(F("}"));
+  mqtt.publishLcdOtaTopic(progressPayload);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_otaSetBaud(uint32_t baud)
+{ // Move both halves of the LCD link, Serial1 TX and the swapped Serial RX, without re-initialising them
+  Serial1.flush();
+  Serial1.updateBaudRate(baud);
+  Serial.updateBaudRate(baud); // note the USB debug TX shares this UART and follows along
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_otaFree()
+{
+  if (_otaBuffer[0] != NULL)
+  {
+    free(_otaBuffer[0]);
+    _otaBuffer[0] = NULL;
+  }
+  if (_otaBuffer[1] != NULL)
+  {
+    free(_otaBuffer[1]);
+    _otaBuffer[1] = NULL;
+  }
+  if (_otaActive && _otaBaud != NEXTION_BAUD)
+  { // the panel reboots into its own rate once the update is over
+    _otaSetBaud(NEXTION_BAUD);
+  }
+  _otaActive = false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 bool hmiNextionClass::otaResponse()
 { // Monitor the serial port for a 0x05 response within our timeout
@@ -597,6 +1276,73 @@ void hmiNextionClass::debug_page_cache(void)
 #endif // NEXTION_CACHE_ENABLED
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::printCache(Print &out)
+{ // Write the page cache as JSON, for http://plate01/api/cache
+  if( !useCache )
+  {
+    out.print(F("{\"enabled\":false}"));
+    return;
+  }
+#if NEXTION_CACHE_ENABLED==(true)
+  out.print(F("{\"enabled\":true,\"activePage\":"));
+  out.print(_activePage);
+  out.print(F(",\"pages\":["));
+  for( uint8_t page=0; page<_cachePageCount; page++ )
+  {
+    if( page > 0 ) { out.print(F(",")); }
+    out.print(F("{\"page\":"));
+    out.print(page);
+    if( _pageIsGlobal[page] )
+    {
+      out.print(F(",\"global\":true,\"buttons\":["));
+    }
+    else
+    {
+      out.print(F(",\"global\":false,\"buttons\":["));
+    }
+    uint32_t bitIdx=1;
+    bool firstButton=true;
+    have_t *have = &(_cache_has[page]);
+    for( uint8_t idx=0; idx<_cacheButtonCount; idx++ )
+    {
+      button_t *current = &(_cached[page][idx]);
+      if( (have->font | have->xcen | have->txt | have->pco | have->bco | have->pco2 | have->bco2) & bitIdx )
+      {
+        if( !firstButton ) { out.print(F(",")); }
+        firstButton=false;
+        out.print(F("{\"b\":"));
+        out.print(idx);
+        if (have->font & bitIdx) { out.print(F(",\"font\":")); out.print(current->font); }
+        if (have->xcen & bitIdx) { out.print(F(",\"xcen\":")); out.print(current->xcen); }
+        if (have->pco & bitIdx)  { out.print(F(",\"pco\":"));  out.print(current->pco); }
+        if (have->bco & bitIdx)  { out.print(F(",\"bco\":"));  out.print(current->bco); }
+        if (have->pco2 & bitIdx) { out.print(F(",\"pco2\":")); out.print(current->pco2); }
+        if (have->bco2 & bitIdx) { out.print(F(",\"bco2\":")); out.print(current->bco2); }
+        if (have->txt & bitIdx && current->txtlen > 0)
+        { // txt is stored as the panel wants it, quotes included, so it is already a JSON string
+          out.print(F(",\"txt\":"));
+          out.print(current->txt);
+        }
+        out.print(F("}"));
+      }
+      bitIdx <<= 1;
+    }
+    out.print(F("],\"legacy\":"));
+    if( _pageCache[page] == NULL )
+    {
+      out.print(F("null"));
+    }
+    else
+    { // legacy cache is already a JSON object
+      out.print(_pageCache[page]);
+    }
+    out.print(F("}"));
+  }
+  out.print(F("]}"));
+#endif // NEXTION_CACHE_ENABLED
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void hmiNextionClass::setActivePage(uint8_t newPage )
 {
@@ -623,18 +1369,91 @@ void hmiNextionClass::setPageGlobal( uint8_t page, bool newFlag )
   }
   else
   {
-    debug.printLn(HMI,String(F("Cache cannot be global for high-order page: ")) + page );
+    DEBUG_PRINTLN(HMI,String(F("Cache cannot be global for high-order page: ")) + page );
   }
 #endif // NEXTION_CACHE_ENABLED
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::setStream( uint8_t page, uint8_t button, bool newFlag )
+{ // register (or forget) an object whose .val should be streamed while it is pressed
+  int freeSlot = -1;
+  for( int idx=0; idx<NEXTION_STREAM_MAX; idx++)
+  {
+    if( _streamPage[idx] == page && _streamButton[idx] == button )
+    { // already known
+      if( !newFlag )
+      {
+        _streamPage[idx] = 0xFF;
+        _streamButton[idx] = 0xFF;
+      }
+      return true;
+    }
+    if( freeSlot < 0 && _streamPage[idx] == 0xFF )
+    {
+      freeSlot = idx;
+    }
+  }
+  if( !newFlag )
+  { // was not streaming anyway
+    return true;
+  }
+  if( freeSlot < 0 )
+  {
+    DEBUG_PRINTLN(HMI,String(F("HMI: [ERROR] no free stream slot for p[")) + page + String(F("].b[")) + button + String(F("]")));
+    return false;
+  }
+  _streamPage[freeSlot] = page;
+  _streamButton[freeSlot] = button;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool hmiNextionClass::_isStreamed(uint8_t page, uint8_t button)
+{
+  for( int idx=0; idx<NEXTION_STREAM_MAX; idx++)
+  {
+    if( _streamPage[idx] == page && _streamButton[idx] == button )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void hmiNextionClass::_pollStream(void)
+{ // ask the panel for the pressed object's .val, one request in flight at a time so values coalesce
+  if (_streamGetPending || ((millis() - _streamTimer) < _streamInterval))
+  { // the last poll is unanswered (it expires after NEXTION_GET_TIMEOUT), or it is too soon
+    return;
+  }
+  _streamTimer = millis();
+  _streamGetPending = true;
+  // getAttr() without its debug line, ten a second would drown the log
+  String streamObject = "p[" + String(_streamActivePage) + "].b[" + String(_streamActiveButton) + "].val";
+  _getAttr(streamObject, NEXTION_REPLY_STREAM, "/" + streamObject);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t hmiNextionClass::_uartDrainMicros()
+{ // write() returns once the bytes are in the TX FIFO. They are all on the wire after this, at 10 bits a byte
+  uint32_t pending = UART_TX_FIFO_SIZE - Serial1.availableForWrite();
+  uint32_t baud = Serial1.baudRate();
+  return micros() + ((baud > 0) ? ((pending * 10000000UL) / baud) : 0);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void hmiNextionClass::_sendCmd(String cmd)
 { // Send a raw command to the Nextion panel
+  uint32_t writeStart = micros();
   Serial1.print(cmd);
   Serial1.write(Suffix, sizeof(Suffix));
-  debug.printLn(HMI,String(F("HMI OUT: ")) + cmd);
+  // connect, sendme and rest answer in their own way, or not at all, even with bkcmd=3
+  latency.uartWritten(writeStart, _uartDrainMicros(), !(cmd.startsWith(F("connect")) || cmd.startsWith(F("sendme")) || cmd.startsWith(F("rest"))));
+  trace.event(TRACE_UART_TX, 0, cmd.length());
+  DEBUG_PRINTLN(HMI,String(F("HMI OUT: ")) + cmd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -645,7 +1464,7 @@ void hmiNextionClass::_connect()
     static uint32_t retryCount = 0;
     if ((_model.length() == 0) && (retryCount < (_retryMax - 2)))
     { // Try issuing the "connect" command a few times
-      debug.printLn(HMI, F("HMI: sending Nextion connect request"));
+      DEBUG_PRINTLN(HMI, F("HMI: sending Nextion connect request"));
       sendCmd("connect");
       retryCount++;
       _checkTimer = millis();
@@ -654,7 +1473,7 @@ void hmiNextionClass::_connect()
     { // If we still don't have model info, try to change nextion serial speed from 9600 to 115200
       _setSpeed();
       retryCount++;
-      debug.printLn(HMI, F("HMI: sending Nextion serial speed 115200 request"));
+      DEBUG_PRINTLN(HMI, F("HMI: sending Nextion serial speed 115200 request"));
       _checkTimer = millis();
     }
     else if ((_lcdVersion < 1) && (retryCount <= _retryMax))
@@ -663,10 +1482,9 @@ void hmiNextionClass::_connect()
       { // one last hail mary, maybe the serial speed is set correctly now
         sendCmd("connect");
       }
-      sendCmd("get " + _lcdVersionQuery);
-      _lcdVersionQueryFlag = true;
+      _getAttr(_lcdVersionQuery, NEXTION_REPLY_VERSION, "");
       retryCount++;
-      debug.printLn(HMI, F("HMI: sending Nextion version query"));
+      DEBUG_PRINTLN(HMI, F("HMI: sending Nextion version query"));
       _checkTimer = millis();
     }
   }
@@ -675,7 +1493,7 @@ void hmiNextionClass::_connect()
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void hmiNextionClass::_setSpeed()
 { // Set the Nextion serial port speed
-  debug.printLn(HMI,F("HMI: No Nextion response, attempting 9600bps connection"));
+  DEBUG_PRINTLN(HMI,F("HMI: No Nextion response, attempting 9600bps connection"));
   Serial1.begin(9600);
   Serial1.write(Suffix, sizeof(Suffix));
   Serial1.print("bauds=115200");
@@ -696,7 +1514,7 @@ void hmiNextionClass::_replayCmd(void)
   //  }
   if( _activePage >= _cachePageCount )
   {
-    debug.printLn(HMI, String(F("Cache cannot replay for high-order page: ")) + _activePage );
+    DEBUG_PRINTLN(HMI, String(F("Cache cannot replay for high-order page: ")) + _activePage );
     return;
   }
   // Q: how badly do all these strings composed this way chew our free RAM?
@@ -762,7 +1580,7 @@ void hmiNextionClass::_replayCmd(void)
   DeserializationError jsonError = deserializeJson(replayCommands, _pageCache[_activePage]);
   if (jsonError)
   { // Couldn't parse incoming JSON command
-    debug.printLn(HMI,String(F("HMI: [ERROR] Failed to replay cache on page change. Reported error: ")) + String(jsonError.c_str()));
+    DEBUG_PRINTLN(HMI,String(F("HMI: [ERROR] Failed to replay cache on page change. Reported error: ")) + String(jsonError.c_str()));
   }
   else
   {
@@ -800,7 +1618,7 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
 
   if( page >= _cachePageCount )
   {
-    debug.printLn(HMI,String(F("Cache not stored for high-order page: ")) + page );
+    DEBUG_PRINTLN(HMI,String(F("Cache not stored for high-order page: ")) + page );
     return;
   }
 
@@ -871,7 +1689,7 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
         _setCachedXcen(page, tgtButton, value.toInt());
         return;
       }
-      debug.printLn(HMI,String(F("Internal: [DEBUG] input token was not loaded into new cache. Old Cache takes over >>")) + cmd + String(F("<<")));
+      DEBUG_PRINTLN(HMI,String(F("Internal: [DEBUG] input token was not loaded into new cache. Old Cache takes over >>")) + cmd + String(F("<<")));
       // so, no matches found, fall down to the legacy code
     }
   }
@@ -887,8 +1705,8 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
     DeserializationError jsonError = deserializeJson(cacheCommands, _pageCache[page]);
     if (jsonError)
     { // Couldn't parse incoming JSON command
-      debug.printLn(HMI,String(F("Internal: [ERROR] Failed to update cache. Reported error: ")) + String(jsonError.c_str()));
-      debug.printLn(HMI,String(F("Internal: [DEBUG] Input String was: >>")) + cmd + String(F("<<, cache was >>")) + _pageCache[page] + String(F("<<")));
+      DEBUG_PRINTLN(HMI,String(F("Internal: [ERROR] Failed to update cache. Reported error: ")) + String(jsonError.c_str()));
+      DEBUG_PRINTLN(HMI,String(F("Internal: [DEBUG] Input String was: >>")) + cmd + String(F("<<, cache was >>")) + _pageCache[page] + String(F("<<")));
       //
       if( _pageCache[page] != NULL )
       { // fragment memory!
@@ -912,7 +1730,7 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
       if(_pageCache[page] == NULL)
       { // oops
         _pageCacheLen[page]=0;
-        debug.printLn(HMI,String(F("Internal: [ERROR] Failed to malloc cache, wanted "))+buflen);
+        DEBUG_PRINTLN(HMI,String(F("Internal: [ERROR] Failed to malloc cache, wanted "))+buflen);
         return;
       }
     }
@@ -922,7 +1740,7 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
       if(_pageCache[page] == NULL)
       { // oops
         _pageCacheLen[page]=0;
-        debug.printLn(HMI,String(F("Internal: [ERROR] Failed to realloc cache, was ")) + _pageCacheLen[page]);
+        DEBUG_PRINTLN(HMI,String(F("Internal: [ERROR] Failed to realloc cache, was ")) + _pageCacheLen[page]);
         return;
       }
     }
@@ -938,7 +1756,7 @@ void hmiNextionClass::_appendCmd(int page, String cmd)
   if( page == 1 )
   { // More Debug
     //    debug.printLn(HMI,String(F("---  ")) + _pageCache[page]);
-    debug.printLn(HMI,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
+    DEBUG_PRINTLN(HMI,String(F("SYSTEM: Heap Status: ")) + String(ESP.getFreeHeap()) + String(F(" ")) + String(ESP.getHeapFragmentation()) + String(F("%")) );
   }
   // and garbage collect
   //cacheCommands.clear();
@@ -1156,14 +1974,14 @@ bool hmiNextionClass::_helperTxtMalloc(uint8_t page, uint8_t button, const char
   }
   else
   {
-    debug.printLn(HMI,String(F("NMI Cache: Unable to handle request for overly long .txt field! Given length ")) + String(newLen) );
+    DEBUG_PRINTLN(HMI,String(F("NMI Cache: Unable to handle request for overly long .txt field! Given length ")) + String(newLen) );
     return false;
   }
   //debug.printLn(HMI,String(F("Internal: [DEBUG] Going to malloc .txt length ")) + _cached[page][button].txtlen);
   _cached[page][button].txt = (char*) malloc( sizeof(char) * _cached[page][button].txtlen );
   if( NULL == _cached[page][button].txt )
   {
-    debug.printLn(HMI,String(F("Internal: [ERROR] Failed to malloc .txt cache, wanted ")) + _cached[page][button].txtlen);
+    DEBUG_PRINTLN(HMI,String(F("Internal: [ERROR] Failed to malloc .txt cache, wanted ")) + _cached[page][button].txtlen);
     _cached[page][button].txtlen=0;
     // do we unset _cache_has bit too?
     return false;
@@ -1202,7 +2020,7 @@ void hmiNextionClass::_setCachedTxt(uint8_t page, uint8_t button, const char *ne
   // (actually, if the malloc failed, we might get here)
   if( NULL == _cached[page][button].txt )
   {
-    debug.printLn(HMI,String(F("Internal: [ERROR] .txt cache NULL at a place where it really should not be.")));
+    DEBUG_PRINTLN(HMI,String(F("Internal: [ERROR] .txt cache NULL at a place where it really should not be.")));
     return;
   }
 
@@ -15,6 +15,22 @@
 
 #include "settings.h"
 #include <Arduino.h>
+#include <Client.h>
+#include <FS.h>
+
+// where the panel's answer to each "get" goes. It answers in the order asked, so these wait in a FIFO
+enum nextionReply_t {
+  NEXTION_REPLY_STATE=0,  // publish to the state topic
+  NEXTION_REPLY_SUBTOPIC, // publish to a state subtopic
+  NEXTION_REPLY_STREAM,   // streaming poll, publish to its subtopic only if the value moved
+  NEXTION_REPLY_VERSION   // our lcdVersion query
+};
+
+typedef struct _get_reply_struct {
+  nextionReply_t kind;
+  String subtopic;        // "/p[1].b[4].val" style, for SUBTOPIC and STREAM
+  uint32_t sentMillis;    // when the get went out, so a lost reply can be given up on
+} getReply_t;
 
 // Ours. But can't be inside the class?
 static const bool     useCache = NEXTION_CACHE_ENABLED;    // when false, disable all the _pageCache code (be like the Upstream project)
@@ -120,13 +136,14 @@ public:
   }
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
-  void getAttr(String hmiAttribute);
+  // the reply is published to replySubtopic under the state topic, or to the state topic itself when blank
+  void getAttr(String hmiAttribute, String replySubtopic = "");
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void sendCmd(String cmd);
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
-  void parseJson(String &strPayload);
+  int16_t parseJson(String &strPayload);
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   bool handleInput();
@@ -140,9 +157,24 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   bool otaResponse();
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // TFT streaming engine, shared by the HTTP upload and HTTP download paths
+  bool otaBegin(uint32_t fileSize, uint32_t maxBaud = NEXTION_OTA_MAX_BAUD);
+  bool otaWrite(const uint8_t *data, size_t length);
+  bool otaStream(Client &source, uint32_t length);
+  bool otaStream(File &source, uint32_t length);
+  bool otaEnd();
+  void otaAbort();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getOtaAccepted() { return _otaAccepted; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void debug_page_cache(void);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void printCache(Print &out);
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   inline uint8_t getActivePage() { return _activePage; }
 
@@ -158,6 +190,12 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void setPageGlobal( uint8_t page, bool newFlag );
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool setStream( uint8_t page, uint8_t button, bool newFlag );
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline void setStreamInterval( uint32_t newInterval ) { _streamInterval = newInterval; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   inline bool getLCDConnected() { return _lcdConnected; }
 
@@ -178,24 +216,103 @@ protected:
   bool     _reportPage0;                // If false, don't report page 0 sendme
   uint32_t _lcdVersion;                 // Int to hold current LCD FW version number
   uint32_t _updateLcdAvailableVersion;  // Int to hold the new LCD FW version number
-  bool     _lcdVersionQueryFlag;        // Flag to set if we've queried lcdVersion
   String   _model;                      // Record reported model number of LCD panel
   uint8_t  _returnIndex;                // Index for nextionreturnBuffer
   uint8_t  _activePage;                 // Track active LCD page
   uint8_t  _returnBuffer[128];          // Byte array to pass around data coming from the panel
-  String   _mqttGetSubtopic;            // MQTT subtopic for incoming commands requesting .val
-  String   _mqttGetSubtopicJSON;        // MQTT object buffer for JSON status when requesting .val
+  getReply_t _getReply[NEXTION_GET_QUEUE]; // destinations of the gets still waiting on the panel, oldest first
+  uint8_t  _getReplyHead;               // index of the oldest waiting get
+  uint8_t  _getReplyCount;              // gets waiting
+
+  // Live .val streaming for sliders while they are held down
+  uint8_t  _streamPage[NEXTION_STREAM_MAX];   // page of each object registered for streaming, 0xFF for unused
+  uint8_t  _streamButton[NEXTION_STREAM_MAX]; // button of each object registered for streaming
+  uint32_t _streamInterval;             // Time in msec between .val polls of the pressed object
+  bool     _streamActive;               // A streaming object is currently pressed
+  uint8_t  _streamActivePage;           // page of the pressed streaming object
+  uint8_t  _streamActiveButton;         // button of the pressed streaming object
+  bool     _streamGetPending;           // A streaming .val poll is waiting in _getReply, only one at a time
+  uint32_t _streamTimer;                // Timer for the last streaming .val request
+  int32_t  _streamLastValue;            // Last streamed value, so we only publish changes
+
+  // TFT streaming engine. One buffer drains to the UART while the other fills from the network
+  uint8_t *_otaBuffer[2];               // malloc'd only while an update runs
+  uint16_t _otaFill[2];                 // bytes held in each buffer
+  uint8_t  _otaTxIndex;                 // which buffer is draining to the UART
+  uint16_t _otaTxOffset;                // bytes of the draining buffer already written
+  uint32_t _otaPartSent;                // bytes written to the UART since the last 0x05 ACK
+  uint16_t _otaPartNum;                 // 4096 byte parts ACKed so far
+  uint32_t _otaFileSize;                // bytes the panel was told to expect
+  uint32_t _otaAccepted;                // bytes handed to the engine
+  uint32_t _otaTransferred;             // bytes written to the UART
+  uint32_t _otaStartTime;               // millis() when the transfer began, for throughput
+  bool     _otaActive;                  // an update is running
+  bool     _otaResult;                  // outcome of the last update, for repeated otaEnd() calls
+  uint32_t _otaBaud;                    // rate the panel accepted for this transfer
+  uint32_t _otaAckMillis;               // time the panel took to ACK the last part
+  uint32_t _otaAckMaxMillis;            // slowest part ACK of this transfer
+  uint32_t _otaProgressTimer;           // millis() of the last progress message
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _otaPump(bool drainAll);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _otaStreamFrom(Stream &source, uint32_t length, Client *connection);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _otaStageHasRoom(uint32_t length);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _otaStage(Client &source, uint32_t length, const String &expectedMd5);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _otaProgress(const __FlashStringHelper *state, bool force);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _otaSetBaud(uint32_t baud);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _otaFree();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _otaLogRate(const __FlashStringHelper *outcome);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _otaPanelRestart();
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _sendCmd(String cmd);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // micros() by which what we have written to Serial1 will have left the TX FIFO
+  uint32_t _uartDrainMicros();
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _connect();
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _setSpeed();
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _isStreamed(uint8_t page, uint8_t button);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _pollStream(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _getAttr(String hmiAttribute, nextionReply_t kind, String replySubtopic);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _getReplyPop(getReply_t &reply);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _getReplyExpire(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // offset just past the JSON array element starting at start, or 0 if it isn't one we can take
+  uint32_t _jsonElementEnd(const char *json, uint32_t length, uint32_t start);
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _replayCmd(void);
 
@@ -0,0 +1,207 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// latency_class.cpp : Class internals for the end to end latency percentiles
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+#include "common.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t LatencyClass::percentile(const latencyRing_t &ring, uint8_t percent)
+{ // Sort a copy of the window. Only runs when we report, and insertion sort is plenty for a few dozen samples
+  uint16_t held = (ring.count < LATENCY_SAMPLES) ? ring.count : LATENCY_SAMPLES;
+  if (held == 0)
+  {
+    return 0;
+  }
+  uint32_t sorted[LATENCY_SAMPLES];
+  for (uint16_t idx = 0; idx < held; idx++)
+  {
+    uint32_t sample = ring.samples[idx];
+    uint16_t slot = idx;
+    while ((slot > 0) && (sorted[slot - 1] > sample))
+    {
+      sorted[slot] = sorted[slot - 1];
+      slot--;
+    }
+    sorted[slot] = sample;
+  }
+  uint16_t rank = ((uint32_t)percent * held + 99) / 100; // ceil(p% of n), 1 based
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+  return sorted[rank - 1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::printRing(Print &out, const latencyRing_t &ring, uint32_t sloUs)
+{
+  out.print(F("{\"n\":")); out.print(ring.count);
+  out.print(F(",\"p50Us\":")); out.print(percentile(ring, 50));
+  out.print(F(",\"p90Us\":")); out.print(percentile(ring, 90));
+  out.print(F(",\"p99Us\":")); out.print(percentile(ring, 99));
+  out.print(F(",\"maxUs\":")); out.print(ring.maxUs);
+  out.print(F(",\"sloUs\":")); out.print(sloUs);
+  out.print(F(",\"overSlo\":")); out.print(ring.overSlo);
+  out.print(F("}"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::printLatency(Print &out)
+{ // {"touch":{..},"attr":{..},"page":{..},"json":{..},"ackLost":n}
+  out.print(F("{\"touch\":"));
+  printRing(out, _touch, LATENCY_TOUCH_SLO);
+  for (uint8_t kind = LATENCY_CMD_ATTR; kind < LATENCY_CMD_KINDS; kind++)
+  {
+    out.print(F(",\""));
+    out.print(kindName((latencyKind_t)kind));
+    out.print(F("\":"));
+    printCmd(out, (latencyKind_t)kind);
+  }
+  out.print(F(",\"ackLost\":")); out.print(_ackLost);
+  out.print(F("}"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::printCmd(Print &out, latencyKind_t kind)
+{ // {"written":{..},"acked":{..},"parseAvgUs":..,"uartAvgUs":..,"unsent":..}
+  const latencyCmd_t &cmd = _cmd[kind];
+  out.print(F("{\"written\":"));
+  printRing(out, cmd.written, LATENCY_CMD_SLO);
+#if NEXTION_ACK_MODE==(true)
+  out.print(F(",\"acked\":"));
+  printRing(out, cmd.acked, LATENCY_CMD_SLO);
+#endif
+  out.print(F(",\"parseAvgUs\":")); out.print((cmd.written.count > 0) ? (uint32_t)(cmd.parseUs / cmd.written.count) : 0);
+  out.print(F(",\"uartAvgUs\":")); out.print((cmd.written.count > 0) ? (uint32_t)(cmd.uartUs / cmd.written.count) : 0);
+  out.print(F(",\"unsent\":")); out.print(cmd.unsent);
+  out.print(F("}"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+const char *LatencyClass::kindName(latencyKind_t kind)
+{ // also the last part of the hasp/<node>/latency/<kind> topic
+  switch (kind)
+  {
+  case LATENCY_CMD_ATTR:
+    return "attr";
+  case LATENCY_CMD_PAGE:
+    return "page";
+  case LATENCY_CMD_JSON:
+    return "json";
+  default:
+    return "none";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::cmdStart()
+{ // called first thing in mqtt_callback()
+  _cmdActive = true;
+  _cmdKind = LATENCY_CMD_NONE;
+  _cmdStartMicros = micros();
+  _cmdWrote = false;
+  _cmdPushed = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::cmdDone()
+{ // called when mqtt_callback() is done, every UART write for the command has been made
+  if (_cmdActive && (_cmdKind != LATENCY_CMD_NONE))
+  {
+    latencyCmd_t &cmd = _cmd[_cmdKind];
+    if (_cmdWrote)
+    {
+      _note(cmd.written, _cmdWireDone - _cmdStartMicros, LATENCY_CMD_SLO);
+      cmd.parseUs += _cmdFirstWrite - _cmdStartMicros;
+      cmd.uartUs += _cmdWireDone - _cmdFirstWrite;
+      if (_cmdPushed && (_ackCount > 0))
+      { // the newest entry waiting is our last panel command, its reply is the one we time
+        _ack[(_ackHead + _ackCount - 1) % LATENCY_ACK_QUEUE].last = true;
+      }
+    }
+    else
+    {
+      cmd.unsent++;
+    }
+  }
+  _cmdActive = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::uartWritten(uint32_t writeMicros, uint32_t wireMicros, bool expectReply)
+{ // Every panel command comes through here, from MQTT or not
+  if (_cmdActive && (_cmdKind != LATENCY_CMD_NONE))
+  {
+    if (!_cmdWrote)
+    {
+      _cmdWrote = true;
+      _cmdFirstWrite = writeMicros;
+    }
+    _cmdWireDone = wireMicros;
+  }
+#if NEXTION_ACK_MODE==(true)
+  if (!expectReply)
+  {
+    return;
+  }
+  if (_ackCount == LATENCY_ACK_QUEUE)
+  { // replies aren't coming back, forget the oldest
+    _ackHead = (_ackHead + 1) % LATENCY_ACK_QUEUE;
+    _ackCount--;
+    _ackLost++;
+  }
+  latencyAck_t &entry = _ack[(_ackHead + _ackCount) % LATENCY_ACK_QUEUE];
+  entry.startMicros = _cmdActive ? _cmdStartMicros : writeMicros;
+  entry.sentMicros = writeMicros;
+  entry.kind = _cmdActive ? _cmdKind : LATENCY_CMD_NONE;
+  entry.last = false;
+  _ackCount++;
+  _cmdPushed = _cmdActive;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::panelReply()
+{ // Replies come back in order. Anything waiting longer than NEXTION_ACK_TIMEOUT lost its reply, skip it
+  uint32_t now = micros();
+  while ((_ackCount > 0) && ((now - _ack[_ackHead].sentMicros) > ((uint32_t)NEXTION_ACK_TIMEOUT * 1000)))
+  {
+    _ackHead = (_ackHead + 1) % LATENCY_ACK_QUEUE;
+    _ackCount--;
+    _ackLost++;
+  }
+  if (_ackCount == 0)
+  {
+    return;
+  }
+  latencyAck_t &entry = _ack[_ackHead];
+  if (entry.last && (entry.kind != LATENCY_CMD_NONE))
+  {
+    _note(_cmd[entry.kind].acked, now - entry.startMicros, LATENCY_CMD_SLO);
+  }
+  _ackHead = (_ackHead + 1) % LATENCY_ACK_QUEUE;
+  _ackCount--;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void LatencyClass::reset()
+{
+  memset(&_touch, 0, sizeof(_touch));
+  _touchStartMicros = 0;
+  memset(_cmd, 0, sizeof(_cmd));
+  _cmdActive = false;
+  _cmdKind = LATENCY_CMD_NONE;
+  _cmdPushed = false;
+  _cmdWrote = false;
+  _ackHead = 0;
+  _ackCount = 0;
+  _ackLost = 0;
+}
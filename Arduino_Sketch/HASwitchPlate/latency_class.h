@@ -0,0 +1,131 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// latency_class.h : End to end latency of the paths a user feels, as percentiles over the latest samples
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+
+// This file is only #included once, mmkay
+#pragma once
+
+#include "settings.h"
+#include <Arduino.h>
+#include <Print.h>
+
+// The newest LATENCY_SAMPLES of one path, in usec, plus running totals since the last reset
+typedef struct _latency_ring_struct {
+  uint32_t samples[LATENCY_SAMPLES];
+  uint32_t count;    // samples ever noted, the ring index is this modulo LATENCY_SAMPLES
+  uint32_t maxUs;    // worst since the last reset, not just in the window
+  uint32_t overSlo;  // samples slower than the path's target
+} latencyRing_t;
+
+// What an MQTT command asked the panel to do
+enum latencyKind_t : uint8_t {
+  LATENCY_CMD_NONE = 0, // not one we time, or no command in progress
+  LATENCY_CMD_ATTR,     // command/p[x].b[y].attr, and the same from the group and snapshot topics
+  LATENCY_CMD_PAGE,     // command/page
+  LATENCY_CMD_JSON,     // command/json, a batch of panel commands
+  LATENCY_CMD_KINDS
+};
+
+// MQTT command to panel, per latencyKind_t
+typedef struct _latency_cmd_struct {
+  latencyRing_t written;  // callback entry to the last byte leaving the UART
+  latencyRing_t acked;    // callback entry to the panel's reply to the last of its commands, NEXTION_ACK_MODE only
+  uint64_t parseUs;       // callback entry to the first UART write: topic matching, JSON parsing, the cache
+  uint64_t uartUs;        // first UART write to the last byte leaving the UART
+  uint32_t unsent;        // commands that wrote nothing, the cache already had the value
+} latencyCmd_t;
+
+// a panel command waiting for its reply, NEXTION_ACK_MODE only
+typedef struct _latency_ack_struct {
+  uint32_t startMicros;   // callback entry of the MQTT command that sent it
+  uint32_t sentMicros;    // when it went to the UART, for the timeout
+  uint8_t  kind;          // latencyKind_t
+  bool     last;          // the last panel command of its MQTT command, the one we time
+} latencyAck_t;
+
+class LatencyClass {
+private:
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // constructor
+  LatencyClass(void) { reset(); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // touch to MQTT: the first byte of a panel frame was read, after waitingMicros in the UART buffer
+  inline void touchStart(uint32_t waitingMicros) { _touchStartMicros = micros() - waitingMicros; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // touch to MQTT: the button press has been handed to the broker
+  inline void touchDone() { _note(_touch, micros() - _touchStartMicros, LATENCY_TOUCH_SLO); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline const latencyRing_t &getTouch() { return _touch; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // MQTT command to panel: callback entry, what kind it turned out to be, and callback exit
+  void cmdStart();
+  inline void cmdKind(latencyKind_t kind) { _cmdKind = kind; }
+  void cmdDone();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // a panel command was written. wireMicros is when its last byte will have left the UART FIFO
+  void uartWritten(uint32_t writeMicros, uint32_t wireMicros, bool expectReply);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // the panel answered a command (bkcmd=3), the oldest one waiting gets it
+  void panelReply();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline const latencyCmd_t &getCmd(latencyKind_t kind) { return _cmd[kind]; }
+  void printCmd(Print &out, latencyKind_t kind);
+  static const char *kindName(latencyKind_t kind);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // nearest rank percentile of the window, 0 with no samples
+  uint32_t percentile(const latencyRing_t &ring, uint8_t percent);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // {"n":..,"p50Us":..,"p90Us":..,"p99Us":..,"maxUs":..,"sloUs":..,"overSlo":..}
+  void printRing(Print &out, const latencyRing_t &ring, uint32_t sloUs);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // every path, for http://plate01/api/latency
+  void printLatency(Print &out);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void reset();
+
+protected:
+  latencyRing_t _touch;       // panel touch frame to MQTT publish of p[x].b[y] ON
+  uint32_t _touchStartMicros; // first byte of the frame arriving
+  latencyCmd_t _cmd[LATENCY_CMD_KINDS];
+  bool     _cmdActive;        // inside the MQTT callback
+  uint8_t  _cmdKind;          // latencyKind_t of the command in the callback
+  uint32_t _cmdStartMicros;   // callback entry
+  bool     _cmdWrote;         // it has written to the UART
+  uint32_t _cmdFirstWrite;    // micros() at its first UART write
+  uint32_t _cmdWireDone;      // when its last byte leaves the UART
+  bool     _cmdPushed;        // it has an entry waiting for a panel reply
+  latencyAck_t _ack[LATENCY_ACK_QUEUE];
+  uint8_t  _ackHead;          // oldest waiting
+  uint8_t  _ackCount;
+  uint32_t _ackLost;          // commands whose reply never came, or was lost to a full queue
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline void _note(latencyRing_t &ring, uint32_t sampleUs, uint32_t sloUs)
+  {
+    ring.samples[ring.count % LATENCY_SAMPLES] = sampleUs;
+    ring.count++;
+    if (sampleUs > ring.maxUs) { ring.maxUs = sampleUs; }
+    if (sampleUs > sloUs) { ring.overSlo++; }
+  }
+};
@@ -14,16 +14,19 @@
 #include "common.h"
 #include <MQTT.h>
 #include <ArduinoOTA.h>
+#include <WiFiClientSecureBearSSL.h>
+#include <StreamString.h>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Our internal objects
 // TODO: can these go into our class? (not if their constructor has arguments!)
 
-// Because the mqttClient object is defined outside the class, then the constant it uses must also be outside the class.
-static const uint16_t _mqttMaxPacketSize    = MQTT_MAX_PACKET_SIZE;         // Size of buffer for incoming MQTT message
-
-WiFiClient wifiMQTTClient;                 // client for MQTT
-MQTTClient mqttClient(_mqttMaxPacketSize);  // MQTT Object
+// The MQTTClient buffer size is a constructor argument, and we only know how much heap we can spare
+// once we are running, so the mqttClient object is created in MQTTClass::begin()
+WiFiClient wifiMQTTClient;                        // client for MQTT
+BearSSL::WiFiClientSecure wifiMQTTSecureClient;   // client for MQTTS
+BearSSL::Session mqttTlsSession;                  // TLS session kept between reconnects, so we can skip the full handshake
+MQTTClient *mqttClient = NULL;                    // MQTT Object
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -34,7 +37,9 @@ MQTTClient mqttClient(_mqttMaxPacketSize);  // MQTT Object
 // and yes, we need a local copy of "self" to handle our callbacks.
 void mqtt_callback(String &strTopic, String &strPayload)
 {
+  latency.cmdStart();
   mqtt.callback(strTopic, strPayload);
+  latency.cmdDone();
 }
 // end callbacks
 
@@ -44,8 +49,29 @@ void MQTTClass::begin()
 { // called in the main code setup, handles our initialisation
   _alive=true;
   _statusUpdateTimer = 0;
-  mqttClient.begin(config.getMQTTServer(), atoi(config.getMQTTPort()), wifiMQTTClient); // Create MQTT service object
-  mqttClient.onMessage(mqtt_callback);                          // Setup MQTT callback function
+  _sessionPresent = false;
+  _tlsMflnRefused = false;
+  _snapshotCount = 0;
+  _largestPacket = 0;
+  _oversizeCount = 0;
+  _connectMillis = 0;
+  _connectHeap = 0;
+  if (mqttClient == NULL)
+  { // MQTTClient allocates a read and a write buffer of this size, so both come out of the heap
+    _maxPacketSize = _choosePacketSize();
+    mqttClient = new MQTTClient(_maxPacketSize);
+    debug.printLn(String(F("MQTT: packet buffer ")) + String(_maxPacketSize) + String(F(" bytes, heap free ")) + String(ESP.getFreeHeap()));
+  }
+  if (config.getMQTTTls())
+  { // MQTTS
+    _setupTls();
+    mqttClient->begin(config.getMQTTServer(), atoi(config.getMQTTPort()), wifiMQTTSecureClient); // Create MQTT service object
+  }
+  else
+  {
+    mqttClient->begin(config.getMQTTServer(), atoi(config.getMQTTPort()), wifiMQTTClient); // Create MQTT service object
+  }
+  mqttClient->onMessage(mqtt_callback);                          // Setup MQTT callback function
   connect();                                                    // Connect to MQTT
 }
 
@@ -56,13 +82,18 @@ void MQTTClass::loop()
   {
     begin();
   }
-  if (!mqttClient.connected())
+  if (!mqttClient->connected())
   { // Check MQTT connection
     debug.printLn("MQTT: not connected, connecting.");
     connect();
   }
 
-  mqttClient.loop();        // MQTT client loop
+  mqttClient->loop();        // MQTT client loop
+  if (!mqttClient->connected() && (mqttClient->lastError() == LWMQTT_BUFFER_TOO_SHORT))
+  { // An incoming packet did not fit our buffer, the client dropped it and the connection with it
+    _oversizeCount++;
+    debug.printLn(String(F("MQTT: [ERROR] incoming packet larger than ")) + String(_maxPacketSize) + String(F(" byte buffer, dropped. Oversize count: ")) + String(_oversizeCount));
+  }
   if ((millis() - _statusUpdateTimer) >= _statusUpdateInterval)
   { // Run periodic status update
     statusUpdate();
@@ -92,6 +123,25 @@ void MQTTClass::connect()
       }
       web.loop();
       ArduinoOTA.handle(); // TODO: move this elsewhere!
+      debug.loop();
+    }
+  }
+  if (config.getMQTTTls() && (config.getMQTTFingerprint()[0] == '\0') && !config.getMQTTTlsInsecure())
+  { // TLS with nothing to check the broker against. Don't pretend it is secure, wait to be configured
+    debug.printLn(F("MQTT: [ERROR] TLS needs a broker fingerprint, or insecure mode set on the configuration page. Not connecting"));
+    nextion.sendCmd("page 0");
+    nextion.setAttr("p[0].b[1].font", "6");
+    nextion.setAttr("p[0].b[1].txt", "\"WiFi Connected!\\r " + String(WiFi.SSID()) + "\\rIP: " + WiFi.localIP().toString() + "\\r\\rMQTT TLS needs\\ra fingerprint:\\rhttp://" + WiFi.localIP().toString() + "\"");
+    while (true)
+    { // Handle HTTP and OTA while we're waiting, saving the config restarts us
+      yield();
+      if (nextion.handleInput())
+      { // Process user input from HMI
+        nextion.processInput();
+      }
+      web.loop();
+      ArduinoOTA.handle();
+      debug.loop();
     }
   }
   // MQTT topic string definitions
@@ -106,14 +156,20 @@ void MQTTClass::connect()
   _lightBrightCommandTopic = "hasp/" + String(config.getHaspNode()) + "/brightness/set";
   _lightBrightStateTopic = "hasp/" + String(config.getHaspNode()) + "/brightness/state";
   _motionStateTopic = "hasp/" + String(config.getHaspNode()) + "/motion/state";
+  _lcdOtaTopic = "hasp/" + String(config.getHaspNode()) + "/lcdota";
+  _snapshotTopic = "hasp/" + String(config.getHaspNode()) + "/snapshot";
+  _postMortemTopic = "hasp/" + String(config.getHaspNode()) + "/postmortem";
+  _profileTopic = "hasp/" + String(config.getHaspNode()) + "/profile";
+  _latencyTopic = "hasp/" + String(config.getHaspNode()) + "/latency";
 
   const String commandSubscription = _commandTopic + "/#";
   const String groupCommandSubscription = _groupCommandTopic + "/#";
   const String lightSubscription = "hasp/" + String(config.getHaspNode()) + "/light/#";
   const String lightBrightSubscription = "hasp/" + String(config.getHaspNode()) + "/brightness/#";
+  const String snapshotSubscription = _snapshotTopic + "/#";
 
   // Loop until we're reconnected to MQTT
-  while (!mqttClient.connected())
+  while (!mqttClient->connected())
   {
     // Create a reconnect counter
     static uint8_t mqttReconnectCount = 0;
@@ -126,47 +182,86 @@ void MQTTClass::connect()
     debug.printLn(String(F("MQTT: Attempting connection to broker ")) + String(config.getMQTTServer()) + " as clientID " + _clientId);
 
     // Set keepAlive, cleanSession, timeout
-    mqttClient.setOptions(30, true, 5000);
+    // A persistent session keeps our subscriptions (and any QoS1 commands sent while we were away)
+    // on the broker, keyed by our clientID, so a short WiFi hiccup does not lose panel updates
+    const bool persistentSession = config.getMQTTPersistent();
+    const int subscribeQos = persistentSession ? 1 : 0;
+    mqttClient->setOptions(30, !persistentSession, 5000);
 
     // declare LWT
-    mqttClient.setWill(_statusTopic.c_str(), "OFF");
+    mqttClient->setWill(_statusTopic.c_str(), "OFF");
+
+    if (config.getMQTTTls() && (config.getMQTTTlsMfln() == MQTT_TLS_MFLN_UNKNOWN))
+    { // no answer kept for this broker yet
+      _probeTlsMfln();
+    }
 
-    if (mqttClient.connect(_clientId.c_str(), config.getMQTTUser(), config.getMQTTPassword()))
+    const uint32_t connectHeap = ESP.getFreeHeap();
+    const uint32_t connectTimer = millis();
+    if (mqttClient->connect(_clientId.c_str(), config.getMQTTUser(), config.getMQTTPassword()))
     { // Attempt to connect to broker, setting last will and testament
-      // Subscribe to our incoming topics
-      if (mqttClient.subscribe(commandSubscription))
-      {
-        debug.printLn(String(F("MQTT: subscribed to ")) + commandSubscription);
+      // With TLS this includes the handshake, which is the part a resumed BearSSL session makes cheap
+      _connectMillis = millis() - connectTimer;
+      _connectHeap = int32_t(connectHeap) - int32_t(ESP.getFreeHeap());
+      debug.printLn(String(F("MQTT: broker connect took ")) + String(_connectMillis) + String(F("ms, heap cost ")) + String(_connectHeap) + (config.getMQTTTls() ? String(F(" (TLS)")) : String()));
+      if (_tlsMflnRefused)
+      { // the broker was up for this handshake, moments after the probe, so it was up to refuse the probe too
+        _tlsMflnRefused = false;
+        config.setMQTTTlsMfln(MQTT_TLS_MFLN_NO);
+        config.saveFile();
       }
-      if (mqttClient.subscribe(groupCommandSubscription))
-      {
-        debug.printLn(String(F("MQTT: subscribed to ")) + groupCommandSubscription);
-      }
-      if (mqttClient.subscribe(lightSubscription))
-      {
-        debug.printLn(String(F("MQTT: subscribed to ")) + lightSubscription);
+      _sessionPresent = persistentSession && mqttClient->sessionPresent();
+      if (_sessionPresent && !mqttFirstConnect)
+      { // The broker kept our session since we last subscribed this run, so our subscriptions are still in place
+        debug.printLn(String(F("MQTT: broker resumed persistent session for ")) + _clientId + String(F(", skipping subscribe")));
       }
-      if (mqttClient.subscribe(lightBrightSubscription))
-      {
-        debug.printLn(String(F("MQTT: subscribed to ")) + lightSubscription);
+      else
+      { // Subscribe to our incoming topics. Always after a boot, as the group name may have changed since the
+        // broker's session was made and our clientID doesn't carry it. Subscribing again is harmless
+        if (mqttClient->subscribe(commandSubscription, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + commandSubscription);
+        }
+        if (mqttClient->subscribe(groupCommandSubscription, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + groupCommandSubscription);
+        }
+        if (mqttClient->subscribe(lightSubscription, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + lightSubscription);
+        }
+        if (mqttClient->subscribe(lightBrightSubscription, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + lightSubscription);
+        }
+        if (mqttClient->subscribe(_statusTopic, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + _statusTopic);
+        }
       }
-      if (mqttClient.subscribe(_statusTopic))
-      {
-        debug.printLn(String(F("MQTT: subscribed to ")) + _statusTopic);
+
+      if (config.getMQTTSnapshot())
+      { // (Re)subscribing always makes the broker send the retained snapshot, session present or not
+        if (mqttClient->subscribe(snapshotSubscription, subscribeQos))
+        {
+          debug.printLn(String(F("MQTT: subscribed to ")) + snapshotSubscription);
+          _hydrateSnapshot();
+        }
       }
 
       if (mqttFirstConnect)
       { // Force any subscribed clients to toggle OFF/ON when we first connect to
         // make sure we get a full panel refresh at power on.  Sending OFF,
         // "ON" will be sent by the _statusTopic subscription action.
+        // The panel itself lost everything over a reboot, so do this even if the broker kept our session.
         debug.printLn(String(F("MQTT: binary_sensor state: [")) + _statusTopic + "] : [OFF]");
-        mqttClient.publish(_statusTopic, "OFF", true, 1);
+        mqttClient->publish(_statusTopic, "OFF", true, 1);
         mqttFirstConnect = false;
       }
       else
-      {
-        debug.printLn(String(F("MQTT: binary_sensor state: [")) + _statusTopic + "] : [ON]");
-        mqttClient.publish(_statusTopic, "ON", true, 1);
+      { // Clear any dangling LWT. On a resumed session queued commands are already on their way too
+        debug.printLn(String(F("MQTT: binary_sensor state")) + (_sessionPresent ? String(F(" (resumed)")) : String()) + String(F(": [")) + _statusTopic + "] : [ON]");
+        mqttClient->publish(_statusTopic, "ON", true, 1);
       }
 
       mqttReconnectCount = 0;
@@ -174,6 +269,14 @@ void MQTTClass::connect()
       // Update panel with MQTT status
       nextion.setAttr("p[0].b[1].txt", "\"WiFi Connected!\\r " + String(WiFi.SSID()) + "\\rIP: " + WiFi.localIP().toString() + "\\r\\rMQTT Connected:\\r " + String(config.getMQTTServer()) + "\"");
       debug.printLn(F("MQTT: connected"));
+      if (trace.hasPostMortem())
+      { // once per boot, retained so it is still there when someone comes looking
+        DEBUG_PRINTLN(MQTT, String(F("MQTT OUT: '")) + _postMortemTopic + String(F("' : '")) + trace.getPostMortem() + String(F("'")));
+        if (mqttClient->publish(_postMortemTopic, trace.getPostMortem(), true, 1))
+        {
+          trace.clearPostMortem();
+        }
+      }
       if (nextion.getActivePage())
       {
         nextion.sendCmd("page " + String(nextion.getActivePage()));
@@ -184,11 +287,11 @@ void MQTTClass::connect()
       mqttReconnectCount++;
       if (mqttReconnectCount > ((_mqttConnectTimeout / 10) - 1))
       {
-        debug.printLn(String(F("MQTT connection attempt ")) + String(mqttReconnectCount) + String(F(" failed with rc ")) + String(mqttClient.returnCode()) + String(F(".  Restarting device.")));
+        debug.printLn(String(F("MQTT connection attempt ")) + String(mqttReconnectCount) + String(F(" failed with rc ")) + String(mqttClient->returnCode()) + String(F(".  Restarting device.")));
         esp.reset();
       }
-      debug.printLn(String(F("MQTT connection attempt ")) + String(mqttReconnectCount) + String(F(" failed with rc ")) + String(mqttClient.returnCode()) + String(F(".  Trying again in 30 seconds.")));
-      nextion.setAttr("p[0].b[1].txt", "\"WiFi Connected:\\r " + String(WiFi.SSID()) + "\\rIP: " + WiFi.localIP().toString() + "\\r\\rMQTT Connect to:\\r " + String(config.getMQTTServer()) + "\\rFAILED rc=" + String(mqttClient.returnCode()) + "\\r\\rRetry in 30 sec\"");
+      debug.printLn(String(F("MQTT connection attempt ")) + String(mqttReconnectCount) + String(F(" failed with rc ")) + String(mqttClient->returnCode()) + String(F(".  Trying again in 30 seconds.")));
+      nextion.setAttr("p[0].b[1].txt", "\"WiFi Connected:\\r " + String(WiFi.SSID()) + "\\rIP: " + WiFi.localIP().toString() + "\\r\\rMQTT Connect to:\\r " + String(config.getMQTTServer()) + "\\rFAILED rc=" + String(mqttClient->returnCode()) + "\\r\\rRetry in 30 sec\"");
       uint32_t mqttReconnectTimer = millis(); // record current time for our timeout
       while ((millis() - mqttReconnectTimer) < 30000)
       { // Handle HTTP and OTA while we're waiting 30sec for MQTT to reconnect
@@ -198,12 +301,79 @@ void MQTTClass::connect()
         }
         web.loop();
         ArduinoOTA.handle();
+        debug.loop();
         delay(10);
       }
     }
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::_setupTls()
+{ // Configure the BearSSL client for MQTTS
+  // The session object survives disconnects, so a reconnect offers the broker our old session ID
+  // and an abbreviated handshake instead of seconds of public-key crypto on the ESP
+  wifiMQTTSecureClient.setSession(&mqttTlsSession);
+  if (config.getMQTTFingerprint()[0] != '\0')
+  { // pin the broker certificate by its SHA1 fingerprint, no CA store or clock required
+    wifiMQTTSecureClient.setFingerprint(config.getMQTTFingerprint());
+  }
+  else if (config.getMQTTTlsInsecure())
+  { // asked for in the config, connect() refuses otherwise
+    debug.printLn(F("MQTT: [WARNING] TLS insecure mode, broker certificate will not be verified"));
+    wifiMQTTSecureClient.setInsecure();
+  }
+  if (config.getMQTTTlsMfln() == MQTT_TLS_MFLN_YES)
+  { // the broker agreed to smaller TLS records, shrink our buffers to match
+    wifiMQTTSecureClient.setBufferSizes(MQTT_TLS_FRAGMENT_SIZE, MQTT_TLS_FRAGMENT_SIZE);
+    debug.printLn(String(F("MQTT: TLS buffers reduced to ")) + String(MQTT_TLS_FRAGMENT_SIZE) + String(F(" bytes")));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::_probeTlsMfln()
+{ // Ask the broker if it takes smaller TLS records. The probe is a connection and part handshake of its
+  // own, so it runs until we have an answer for this broker and the answer is kept
+  _tlsMflnRefused = false;
+  if (wifiMQTTSecureClient.probeMaxFragmentLength(config.getMQTTServer(), atoi(config.getMQTTPort()), MQTT_TLS_FRAGMENT_SIZE))
+  { // only a broker that answered can agree
+    config.setMQTTTlsMfln(MQTT_TLS_MFLN_YES);
+    config.saveFile();
+    wifiMQTTSecureClient.setBufferSizes(MQTT_TLS_FRAGMENT_SIZE, MQTT_TLS_FRAGMENT_SIZE);
+    debug.printLn(String(F("MQTT: TLS buffers reduced to ")) + String(MQTT_TLS_FRAGMENT_SIZE) + String(F(" bytes")));
+  }
+  else
+  { // a false is also what a broker or network outage gives. connect() only believes it if the
+    // handshake straight after this one gets through
+    _tlsMflnRefused = true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::_hydrateSnapshot()
+{ // Pump the client until the retained snapshot has been delivered, so the panel is drawn before we go live
+  // The broker sends all retained messages straight after the SUBACK, so we stop once it has gone quiet
+  _snapshotCount = 0;
+  uint16_t lastCount = 0;
+  const uint32_t hydrateStart = millis();
+  uint32_t quietTimer = hydrateStart;
+  while (mqttClient->connected() && ((millis() - hydrateStart) < _snapshotTimeout))
+  {
+    mqttClient->loop();
+    if (_snapshotCount != lastCount)
+    {
+      lastCount = _snapshotCount;
+      quietTimer = millis();
+    }
+    else if ((millis() - quietTimer) >= _snapshotQuiet)
+    {
+      break;
+    }
+    yield();
+  }
+  debug.printLn(String(F("MQTT: snapshot restored ")) + String(_snapshotCount) + String(F(" attributes in ")) + String(millis() - hydrateStart) + String(F("ms")));
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::callback(String &strTopic, String &strPayload)
 { // Handle incoming commands from MQTT
@@ -211,6 +381,7 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
   // strTopic: homeassistant/haswitchplate/devicename/command/p[1].b[4].txt
   // strPayload: "Lights On"
   // subTopic: p[1].b[4].txt
+  trace.event(TRACE_MQTT_IN, 0, strPayload.length());
 
   // Incoming Namespace (replace /device/ with /group/ for group commands)
   // '[...]/device/command' -m '' = No command requested, respond with statusUpdate()
@@ -224,8 +395,15 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
   // '[...]/device/command/espupdate' -m '' = espStartOta("espFirmwareUrl")
   // '[...]/device/command/p[1].b[4].txt' -m '' = nextion.getAttr("p[1].b[4].txt")
   // '[...]/device/command/p[1].b[4].txt' -m '"Lights On"' = nextion.setAttr("p[1].b[4].txt", "\"Lights On\"")
+  // '[...]/device/command/stream' -m 'p[4].b[1]' = nextion.setStream(4, 1, true)
+  // '[...]/device/snapshot/p[1].b[4].txt' -m '"Lights On"' (retained) = nextion.setAttr("p[1].b[4].txt", "\"Lights On\"")
 
-  debug.printLn(MQTT, String(F("MQTT IN: '")) + strTopic + "' : '" + strPayload + "'");
+  DEBUG_PRINTLN(MQTT, String(F("MQTT IN: '")) + strTopic + "' : '" + strPayload + "'");
+
+  if ((strTopic.length() + strPayload.length()) > _largestPacket)
+  { // Track the high-water mark so the buffer can be tuned per plate
+    _largestPacket = strTopic.length() + strPayload.length();
+  }
 
   if (((strTopic == _commandTopic) || (strTopic == _groupCommandTopic)) && (strPayload == ""))
   {                     // '[...]/device/command' -m '' = No command requested, respond with statusUpdate()
@@ -237,6 +415,7 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
   }
   else if (strTopic == (_commandTopic + "/page") || strTopic == (_groupCommandTopic + "/page"))
   { // '[...]/device/command/page' -m '1' == nextion.sendCmd("page 1")
+    latency.cmdKind(LATENCY_CMD_PAGE);
     nextion.changePage(strPayload.toInt());
   }
   else if (strTopic == (_commandTopic + "/globalpage") || strTopic == (_groupCommandTopic + "/globalpage"))
@@ -261,8 +440,24 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
       nextion.setPageGlobal(strPayload.toInt(),false);
     }
   }
+  else if (strTopic == (_commandTopic + "/stream") || strTopic == (_groupCommandTopic + "/stream"))
+  { // '[...]/device/command/stream' -m 'p[4].b[1]' streams .val of that object while it is pressed
+    _setStreamFromPayload(strPayload, true);
+  }
+  else if (strTopic == (_commandTopic + "/nostream") || strTopic == (_groupCommandTopic + "/nostream"))
+  { // '[...]/device/command/nostream' -m 'p[4].b[1]' only reports .val of that object on release
+    _setStreamFromPayload(strPayload, false);
+  }
+  else if (strTopic == (_commandTopic + "/streamrate") || strTopic == (_groupCommandTopic + "/streamrate"))
+  { // '[...]/device/command/streamrate' -m '100' polls streaming objects every 100 msec
+    if (strPayload.toInt() > 0)
+    {
+      nextion.setStreamInterval(strPayload.toInt());
+    }
+  }
   else if (strTopic == (_commandTopic + "/json") || strTopic == (_groupCommandTopic + "/json"))
   {                               // '[...]/device/command/json' -m '["dim=5", "page 1"]' = nextion.sendCmd("dim=50"), nextion.sendCmd("page 1")
+    latency.cmdKind(LATENCY_CMD_JSON);
     nextion.parseJson(strPayload); // Send to nextion.parseJson()
   }
   else if (strTopic == (_commandTopic + "/statusupdate") || strTopic == (_groupCommandTopic + "/statusupdate"))
@@ -296,6 +491,12 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
     debug.printLn(F("MQTT: Rebooting device"));
     esp.reset();
   }
+  else if (strTopic == (_commandTopic + "/profilereset") || strTopic == (_groupCommandTopic + "/profilereset"))
+  { // '[...]/device/command/profilereset' == start the loop, task and latency statistics again
+    debug.printLn(F("MQTT: Profile reset"));
+    scheduler.resetProfile();
+    latency.reset();
+  }
   else if (strTopic == (_commandTopic + "/lcdreboot") || strTopic == (_groupCommandTopic + "/lcdreboot"))
   { // '[...]/device/command/lcdreboot' == reboot LCD panel)
     debug.printLn(F("MQTT: Rebooting LCD"));
@@ -315,159 +516,300 @@ void MQTTClass::callback(String &strTopic, String &strPayload)
   else if (strTopic.startsWith(_commandTopic) && (strPayload == ""))
   { // '[...]/device/command/p[1].b[4].txt' -m '' == nextion.getAttr("p[1].b[4].txt")
     String subTopic = strTopic.substring(_commandTopic.length() + 1);
-    _getSubtopic = "/" + subTopic;
-    nextion.getAttr(subTopic);
+    nextion.getAttr(subTopic, "/" + subTopic);
   }
   else if (strTopic.startsWith(_groupCommandTopic) && (strPayload == ""))
   { // '[...]/group/command/p[1].b[4].txt' -m '' == nextion.getAttr("p[1].b[4].txt")
     String subTopic = strTopic.substring(_groupCommandTopic.length() + 1);
-    _getSubtopic = "/" + subTopic;
-    nextion.getAttr(subTopic);
+    nextion.getAttr(subTopic, "/" + subTopic);
   }
   else if (strTopic.startsWith(_commandTopic))
   { // '[...]/device/command/p[1].b[4].txt' -m '"Lights On"' == nextion.setAttr("p[1].b[4].txt", "\"Lights On\"")
     String subTopic = strTopic.substring(_commandTopic.length() + 1);
+    latency.cmdKind(LATENCY_CMD_ATTR);
     nextion.setAttr(subTopic, strPayload);
   }
   else if (strTopic.startsWith(_groupCommandTopic))
   { // '[...]/group/command/p[1].b[4].txt' -m '"Lights On"' == nextion.setAttr("p[1].b[4].txt", "\"Lights On\"")
     String subTopic = strTopic.substring(_groupCommandTopic.length() + 1);
+    latency.cmdKind(LATENCY_CMD_ATTR);
     nextion.setAttr(subTopic, strPayload);
   }
+  else if (strTopic.startsWith(_snapshotTopic + "/"))
+  { // '[...]/device/snapshot/p[1].b[4].txt' -m '"Lights On"' == nextion.setAttr("p[1].b[4].txt", "\"Lights On\"")
+    if (strPayload != "")
+    { // an empty payload is someone clearing the retained value, nothing to draw
+      String subTopic = strTopic.substring(_snapshotTopic.length() + 1);
+      latency.cmdKind(LATENCY_CMD_ATTR);
+      nextion.setAttr(subTopic, strPayload);
+      _snapshotCount++;
+    }
+  }
   else if (strTopic == _lightBrightCommandTopic)
   { // change the brightness from the light topic
     int panelDim = map(strPayload.toInt(), 0, 255, 0, 100);
     nextion.setAttr("dim", String(panelDim));
     nextion.sendCmd("dims=dim");
-    mqttClient.publish(_lightBrightStateTopic, strPayload);
+    mqttClient->publish(_lightBrightStateTopic, strPayload);
   }
   else if (strTopic == _lightCommandTopic && strPayload == "OFF")
   { // set the panel dim OFF from the light topic, saving current dim level first
     nextion.sendCmd("dims=dim");
     nextion.setAttr("dim", "0");
-    mqttClient.publish(_lightStateTopic, "OFF");
+    mqttClient->publish(_lightStateTopic, "OFF");
   }
   else if (strTopic == _lightCommandTopic && strPayload == "ON")
   { // set the panel dim ON from the light topic, restoring saved dim level
     nextion.sendCmd("dim=dims");
-    mqttClient.publish(_lightStateTopic, "ON");
+    mqttClient->publish(_lightStateTopic, "ON");
   }
   else if (strTopic == _statusTopic && strPayload == "OFF")
   { // catch a dangling LWT from a previous connection if it appears
-    mqttClient.publish(_statusTopic, "ON");
+    mqttClient->publish(_statusTopic, "ON");
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::_setStreamFromPayload(String &strPayload, bool newFlag)
+{ // turn 'p[4].b[1]' into page 4 button 1 and hand it to the panel
+  int pageStart = strPayload.indexOf("p[");
+  int buttonStart = strPayload.indexOf("].b[");
+  if (pageStart < 0 || buttonStart < 0)
+  {
+    DEBUG_PRINTLN(MQTT, String(F("MQTT: [ERROR] stream expects 'p[x].b[y]', got '")) + strPayload + "'");
+    return;
+  }
+  uint8_t page = strPayload.substring(pageStart + 2, buttonStart).toInt();
+  uint8_t button = strPayload.substring(buttonStart + 4).toInt();
+  nextion.setStream(page, button, newFlag);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::statusUpdate()
 { // Periodically publish a JSON string indicating system status
+  if (mqttClient == NULL) { return; } // not begun yet, nowhere to publish
   _statusUpdateTimer = millis();
-  String statusPayload = "{";
-  statusPayload += String(F("\"status\":\"available\","));
-  statusPayload += String(F("\"espVersion\":")) + String(config.getHaspVersion()) + String(F(","));
+  StreamString statusPayload;
+  printStatus(statusPayload);
+
+  mqttClient->publish(_sensorTopic, statusPayload, true, 1);
+  mqttClient->publish(_statusTopic, "ON", true, 1);
+  debug.printLn(String(F("MQTT: status update: ")) + String(statusPayload));
+  debug.printLn(String(F("MQTT: binary_sensor state: [")) + _statusTopic + "] : [ON]");
+  nextion.debug_page_cache();
+  publishProfile();
+  publishLatency();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::publishLatency()
+{ // percentiles over the latest samples of each end to end path
+  StreamString touchPayload;
+  latency.printRing(touchPayload, latency.getTouch(), LATENCY_TOUCH_SLO);
+  mqttClient->publish(_latencyTopic + "/touch", touchPayload);
+  for (uint8_t kind = LATENCY_CMD_ATTR; kind < LATENCY_CMD_KINDS; kind++)
+  {
+    StreamString cmdPayload;
+    latency.printCmd(cmdPayload, (latencyKind_t)kind);
+    mqttClient->publish(_latencyTopic + "/" + latency.kindName((latencyKind_t)kind), cmdPayload);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::publishProfile()
+{ // One small message per task, so none of them needs a big packet buffer
+#if SCHEDULER_ENABLED==(true) && SCHEDULER_PROFILE_ENABLED==(true)
+  StreamString loopPayload;
+  scheduler.printStat(loopPayload, scheduler.getLoopStat());
+  mqttClient->publish(_profileTopic + "/loop", loopPayload);
+  for (uint8_t idx = 0; idx < scheduler.getTaskCount(); idx++)
+  {
+    StreamString taskPayload;
+    scheduler.printStat(taskPayload, scheduler.getTask(idx).stat);
+    mqttClient->publish(_profileTopic + "/" + scheduler.getTask(idx).name, taskPayload);
+  }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::printStatus(Print &out)
+{ // Write the status JSON, shared by statusUpdate() and http://plate01/api/status
+  out.print(F("{"));
+  out.print(F("\"status\":\"available\","));
+  out.print(F("\"espVersion\":")); out.print(config.getHaspVersion()); out.print(F(","));
   if (config.isEspUpdateAvailable())
   {
-    statusPayload += String(F("\"updateEspAvailable\":true,"));
+    out.print(F("\"updateEspAvailable\":true,"));
   }
   else
   {
-    statusPayload += String(F("\"updateEspAvailable\":false,"));
+    out.print(F("\"updateEspAvailable\":false,"));
   }
   if (nextion.getLCDConnected())
   {
-    statusPayload += String(F("\"lcdConnected\":true,"));
+    out.print(F("\"lcdConnected\":true,"));
   }
   else
   {
-    statusPayload += String(F("\"lcdConnected\":false,"));
+    out.print(F("\"lcdConnected\":false,"));
   }
-  statusPayload += String(F("\"lcdVersion\":\"")) + String(nextion.getLCDVersion()) + String(F("\","));
+  out.print(F("\"lcdVersion\":\"")); out.print(nextion.getLCDVersion()); out.print(F("\","));
   if (config.isLcdUpdateAvailable())
   {
-    statusPayload += String(F("\"updateLcdAvailable\":true,"));
+    out.print(F("\"updateLcdAvailable\":true,"));
   }
   else
   {
-    statusPayload += String(F("\"updateLcdAvailable\":false,"));
-  }
-  statusPayload += String(F("\"espUptime\":")) + String(int32_t(millis() / 1000)) + String(F(","));
-  statusPayload += String(F("\"signalStrength\":")) + String(WiFi.RSSI()) + String(F(","));
-  statusPayload += String(F("\"haspIP\":\"")) + WiFi.localIP().toString() + String(F("\","));
-  statusPayload += String(F("\"heapFree\":")) + String(ESP.getFreeHeap()) + String(F(","));
-  statusPayload += String(F("\"heapFragmentation\":")) + String(ESP.getHeapFragmentation()) + String(F(","));
-  statusPayload += String(F("\"espCore\":\"")) + String(ESP.getCoreVersion()) + String(F("\""));
-  statusPayload += "}";
-
-  mqttClient.publish(_sensorTopic, statusPayload, true, 1);
-  mqttClient.publish(_statusTopic, "ON", true, 1);
-  debug.printLn(String(F("MQTT: status update: ")) + String(statusPayload));
-  debug.printLn(String(F("MQTT: binary_sensor state: [")) + _statusTopic + "] : [ON]");
-  nextion.debug_page_cache();
+    out.print(F("\"updateLcdAvailable\":false,"));
+  }
+  if (_sessionPresent)
+  {
+    out.print(F("\"mqttSessionResumed\":true,"));
+  }
+  else
+  {
+    out.print(F("\"mqttSessionResumed\":false,"));
+  }
+  out.print(F("\"mqttConnectMs\":")); out.print(_connectMillis); out.print(F(","));
+  out.print(F("\"mqttConnectHeap\":")); out.print(_connectHeap); out.print(F(","));
+  out.print(F("\"mqttBufferSize\":")); out.print(_maxPacketSize); out.print(F(","));
+  out.print(F("\"mqttLargestPacket\":")); out.print(_largestPacket); out.print(F(","));
+  out.print(F("\"mqttOversize\":")); out.print(_oversizeCount); out.print(F(","));
+  out.print(F("\"loopMaxMs\":")); out.print(esp.getLoopMaxMicros() / 1000); out.print(F(","));
+  out.print(F("\"idlePercent\":")); out.print(scheduler.getIdlePercent()); out.print(F(","));
+  out.print(F("\"touchP50Us\":")); out.print(latency.percentile(latency.getTouch(), 50)); out.print(F(","));
+  out.print(F("\"touchP99Us\":")); out.print(latency.percentile(latency.getTouch(), 99)); out.print(F(","));
+  out.print(F("\"touchOverSlo\":")); out.print(latency.getTouch().overSlo); out.print(F(","));
+  out.print(F("\"webLoopMaxMs\":")); out.print(web.getWebLoopMaxMicros() / 1000); out.print(F(","));
+  out.print(F("\"logMaxUs\":")); out.print(debug.getLogAppendMaxMicros()); out.print(F(","));
+  out.print(F("\"logDrainMaxUs\":")); out.print(debug.getLogDrainMaxMicros()); out.print(F(","));
+  out.print(F("\"logSyncMaxUs\":")); out.print(debug.getLogSyncMaxMicros()); out.print(F(","));
+  out.print(F("\"logDropped\":")); out.print(debug.getLogDropped()); out.print(F(","));
+  out.print(F("\"syslogSent\":")); out.print(debug.getSyslogSent()); out.print(F(","));
+  out.print(F("\"syslogDropped\":")); out.print(debug.getSyslogDropped()); out.print(F(","));
+  out.print(F("\"logSkippedHmi\":")); out.print(debug.getLogSkipped(HMI)); out.print(F(","));
+  out.print(F("\"logSkippedMqtt\":")); out.print(debug.getLogSkipped(MQTT)); out.print(F(","));
+  out.print(F("\"espUptime\":")); out.print(int32_t(millis() / 1000)); out.print(F(","));
+  out.print(F("\"signalStrength\":")); out.print(WiFi.RSSI()); out.print(F(","));
+  out.print(F("\"haspIP\":\"")); out.print(WiFi.localIP().toString()); out.print(F("\","));
+  out.print(F("\"heapFree\":")); out.print(ESP.getFreeHeap()); out.print(F(","));
+  out.print(F("\"heapFragmentation\":")); out.print(ESP.getHeapFragmentation()); out.print(F(","));
+  out.print(F("\"espCore\":\"")); out.print(ESP.getCoreVersion()); out.print(F("\""));
+  out.print(F("}"));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-bool MQTTClass::clientIsConnected() { return mqttClient.connected(); }
+bool MQTTClass::clientIsConnected() { return (mqttClient != NULL) && mqttClient->connected(); }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MQTTClass::hasInput()
+{
+  if (!clientIsConnected())
+  {
+    return true;
+  }
+  return config.getMQTTTls() ? (wifiMQTTSecureClient.available() > 0) : (wifiMQTTClient.available() > 0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-String MQTTClass::clientReturnCode() { return String(mqttClient.returnCode()); }
+String MQTTClass::clientReturnCode() { return (mqttClient != NULL) ? String(mqttClient->returnCode()) : String(F("none")); }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 String MQTTClass::getClientID() { return _clientId; }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void MQTTClass::publishMotionTopic(String msg) { mqttClient.publish(_motionStateTopic, msg); }
+bool MQTTClass::getSessionPresent() { return _sessionPresent; }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MQTTClass::publishMotionTopic(String msg) { if (mqttClient != NULL) { mqttClient->publish(_motionStateTopic, msg); } }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void MQTTClass::publishStateTopic(String msg) { mqttClient.publish(_stateTopic, msg); }
+void MQTTClass::publishStateTopic(String msg) { if (mqttClient != NULL) { mqttClient->publish(_stateTopic, msg); } }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void MQTTClass::publishStatusTopic(String msg) { mqttClient.publish(_statusTopic, msg); }
+void MQTTClass::publishLcdOtaTopic(String msg) { if (mqttClient != NULL) { mqttClient->publish(_lcdOtaTopic, msg); } }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void MQTTClass::publishButtonEvent(String page, String buttonID, String newState)
-{ // Publish a message that buttonID on page is now newState
+void MQTTClass::publishStatusTopic(String msg) { if (mqttClient != NULL) { mqttClient->publish(_statusTopic, msg); } }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool MQTTClass::publishButtonEvent(String page, String buttonID, String newState)
+{ // Publish a message that buttonID on page is now newState. True if the client took it
+  if (mqttClient == NULL) { return false; } // not begun yet, nowhere to publish
   String mqttButtonTopic = _stateTopic + "/p[" + page + "].b[" + buttonID + "]";
-  mqttClient.publish(mqttButtonTopic, newState);
-  debug.printLn(MQTT,String(F("MQTT OUT: '")) + mqttButtonTopic + "' : '" + newState + "'");
+  bool published = mqttClient->publish(mqttButtonTopic, newState);
+  trace.event(TRACE_MQTT_OUT, 0, newState.length());
+  DEBUG_PRINTLN(MQTT,String(F("MQTT OUT: '")) + mqttButtonTopic + "' : '" + newState + "'");
+  return published;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::publishButtonJSONEvent(String page, String buttonID, String newState)
 { // Publish a JSON message stating button = newState, on the State JSON Topic
+  if (mqttClient == NULL) { return; } // not begun yet, nowhere to publish
   String mqttButtonJSONEvent = String(F("{\"event\":\"p[")) + String(page) + String(F("].b[")) + String(buttonID) + String(F("]\", \"value\":\"")) + newState + String(F("""}"));
-  mqttClient.publish(_stateJSONTopic, mqttButtonJSONEvent);
+  mqttClient->publish(_stateJSONTopic, mqttButtonJSONEvent);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::publishStatePage(String page)
 { // Publish a page message on the State Topic
+  if (mqttClient == NULL) { return; } // not begun yet, nowhere to publish
   String mqttPageTopic = _stateTopic + "/page";
-  mqttClient.publish(mqttPageTopic, page);
-  debug.printLn(MQTT, String(F("MQTT OUT: '")) + mqttPageTopic + "' : '" + page + "'");
+  mqttClient->publish(mqttPageTopic, page);
+  trace.event(TRACE_MQTT_OUT, 0, page.length());
+  DEBUG_PRINTLN(MQTT, String(F("MQTT OUT: '")) + mqttPageTopic + "' : '" + page + "'");
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::publishStateSubTopic(String subtopic, String newState)
 { // extend the State Topic with a subtopic and publish a newState message on it
+  if (mqttClient == NULL) { return; } // not begun yet, nowhere to publish
   String mqttReturnTopic = _stateTopic + subtopic;
-  mqttClient.publish(mqttReturnTopic, newState);
-  debug.printLn(MQTT,String(F("MQTT OUT: '")) + mqttReturnTopic + "' : '" + newState + "]");
+  mqttClient->publish(mqttReturnTopic, newState);
+  trace.event(TRACE_MQTT_OUT, 0, newState.length());
+  DEBUG_PRINTLN(MQTT,String(F("MQTT OUT: '")) + mqttReturnTopic + "' : '" + newState + "]");
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 uint16_t MQTTClass::getMaxPacketSize(void)
-{ // return the (non-class) variable for our network buffer. See note at the top of mqtt_class.cpp
-  return _mqttMaxPacketSize;
+{ // return the buffer size our mqttClient was created with. See note at the top of mqtt_class.cpp
+  return _maxPacketSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint16_t MQTTClass::_choosePacketSize(void)
+{ // Pick our packet buffer size, either from config or from the free heap we have at boot
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t packetSize = config.getMQTTBufferSize();
+  if (packetSize == 0)
+  { // auto size, a share of the free heap within sensible bounds
+    packetSize = freeHeap / MQTT_PACKET_HEAP_DIVISOR;
+    if (packetSize > MQTT_MAX_PACKET_SIZE)
+    {
+      packetSize = MQTT_MAX_PACKET_SIZE;
+    }
+  }
+  else if (packetSize > (freeHeap / 4))
+  { // the user asked for more than we can safely give, two buffers of this size must leave half the heap free
+    debug.printLn(String(F("MQTT: [WARNING] requested buffer ")) + String(packetSize) + String(F(" too large for heap ")) + String(freeHeap));
+    packetSize = freeHeap / 4;
+  }
+  if (packetSize < MQTT_MIN_PACKET_SIZE)
+  {
+    packetSize = MQTT_MIN_PACKET_SIZE;
+  }
+  return packetSize;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void MQTTClass::goodbye()
 { // like a Last-Will-and-Testament, publish something when we are going offline
-  if (mqttClient.connected())
+  if (clientIsConnected())
   {
-    mqttClient.publish(_statusTopic, "OFF", true, 1);
-    mqttClient.publish(_sensorTopic, "{\"status\": \"unavailable\"}", true, 1);
-    mqttClient.disconnect();
+    mqttClient->publish(_statusTopic, "OFF", true, 1);
+    mqttClient->publish(_sensorTopic, "{\"status\": \"unavailable\"}", true, 1);
+    mqttClient->disconnect();
   }
 }
@@ -43,9 +43,16 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void statusUpdate();
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void printStatus(Print &out);
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   bool clientIsConnected();
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // bytes from the broker are waiting, or we aren't connected and loop() has work to do
+  bool hasInput();
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   String clientReturnCode();
 
@@ -59,7 +66,18 @@ public:
   void publishStateTopic(String msg);
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
-  void publishButtonEvent(String page, String buttonID, String newState);
+  void publishLcdOtaTopic(String msg);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // scheduler timing, one message per task on hasp/<node>/profile/<task>. Sent with each status update
+  void publishProfile();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // end to end latency on hasp/<node>/latency/<path>. Sent with each status update
+  void publishLatency();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool publishButtonEvent(String page, String buttonID, String newState);
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void publishButtonJSONEvent(String page, String buttonID, String newState);
@@ -73,19 +91,37 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   String getClientID(void);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool getSessionPresent(void);
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   uint16_t getMaxPacketSize(void);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint16_t getLargestPacket(void) { return _largestPacket; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getOversizeCount(void) { return _oversizeCount; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getConnectMillis(void) { return _connectMillis; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline int32_t getConnectHeap(void) { return _connectHeap; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void goodbye();
 
 protected:
   const uint32_t _statusUpdateInterval = MQTT_STATUS_UPDATE_INTERVAL;  // Time in msec between publishing MQTT status updates (5 minutes)
   const uint32_t _mqttConnectTimeout   = CONNECTION_TIMEOUT;           // Timeout for WiFi and MQTT connection attempts in seconds
+  const uint32_t _snapshotTimeout      = MQTT_SNAPSHOT_TIMEOUT;        // Longest time in msec to wait for retained snapshot messages
+  const uint32_t _snapshotQuiet        = MQTT_SNAPSHOT_QUIET;          // Snapshot is complete after this many msec without a message
 
   bool   _alive;                                   // Flag that data structures are initialised and functions can run without error
   String _clientId;                                // Auto-generated MQTT ClientID
-  String _getSubtopic;                             // MQTT subtopic for incoming commands requesting .val
+  bool   _sessionPresent;                          // Broker reported "session present" on our last CONNACK
+  bool   _tlsMflnRefused;                          // The MFLN probe said no, saved once a TLS connect shows the broker was there to ask
   String _getSubtopicJSON;                         // MQTT object buffer for JSON status when requesting .val
   String _stateTopic;                              // MQTT topic for outgoing panel interactions
   String _stateJSONTopic;                          // MQTT topic for outgoing panel interactions in JSON format
@@ -99,6 +135,32 @@ protected:
   String _lightBrightCommandTopic;                 // MQTT topic for incoming panel backlight dimmer commands
   String _lightBrightStateTopic;                   // MQTT topic for outgoing panel backlight dimmer state
   String _motionStateTopic;                        // MQTT topic for outgoing motion sensor state
+  String _lcdOtaTopic;                             // MQTT topic for outgoing LCD firmware update progress
+  String _postMortemTopic;                         // MQTT topic for the RTC crash log left by the last reset
+  String _profileTopic;                            // MQTT topic root for scheduler timing statistics
+  String _latencyTopic;                            // MQTT topic root for end to end latency percentiles
+  String _snapshotTopic;                           // MQTT topic tree holding retained panel attributes for hydration
+  uint16_t _snapshotCount;                         // Count of snapshot attributes applied since the last connect
   uint32_t _statusUpdateTimer;                     // Timer for update check
+  uint16_t _maxPacketSize;                         // Size of buffer for incoming MQTT message, chosen at begin()
+  uint16_t _largestPacket;                         // Largest topic+payload we have received, to help tune _maxPacketSize
+  uint32_t _oversizeCount;                         // Count of incoming packets dropped for being larger than our buffer
+  uint32_t _connectMillis;                         // Time in msec our last broker connect took, including any TLS handshake
+  int32_t  _connectHeap;                           // Heap in bytes our last broker connect consumed, including any TLS buffers
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _hydrateSnapshot();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  uint16_t _choosePacketSize(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _setStreamFromPayload(String &strPayload, bool newFlag);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _setupTls(void);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _probeTlsMfln(void);
 
 };
@@ -0,0 +1,197 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// scheduler_class.cpp : Class internals for the cooperative loop() scheduler
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+#include "common.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::begin()
+{ // called in the main code setup, once every task is added
+  _alive = true;
+  _idleSince = millis();
+  for (uint8_t idx = 0; idx < _taskCount; idx++)
+  {
+    _tasks[idx].lastRun = millis();
+    DEBUG_PRINTLN(SYSTEM, String(F("SCHED: ")) + String(_tasks[idx].name) + String(F(" priority ")) + String(_tasks[idx].priority) + String(F(" every ")) + String(_tasks[idx].period) + String(F("ms")) + (_tasks[idx].ready ? String(F(" or when ready")) : String()));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool SchedulerClass::add(const char *name, tracePhase_t phase, schedRun_t run, uint32_t period, uint8_t priority, schedReady_t ready)
+{ // Insertion sort, after any task of the same priority so ties run in the order they were added
+  if (_taskCount >= SCHEDULER_MAX_TASKS)
+  {
+    debug.printLn(String(F("SCHED: [ERROR] no room for task ")) + String(name));
+    return false;
+  }
+  uint8_t slot = _taskCount;
+  while ((slot > 0) && (_tasks[slot - 1].priority > priority))
+  {
+    _tasks[slot] = _tasks[slot - 1];
+    slot--;
+  }
+  _tasks[slot].name = name;
+  _tasks[slot].run = run;
+  _tasks[slot].ready = ready;
+  _tasks[slot].period = period;
+  _tasks[slot].priority = priority;
+  _tasks[slot].phase = phase;
+  _tasks[slot].lastRun = millis();
+  _tasks[slot].runs = 0;
+  _clearStat(_tasks[slot].stat);
+  _taskCount++;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool SchedulerClass::loop()
+{ // Every task that is due, highest priority first. Urgent tasks are looked at again after each of the others
+  bool ranAny = false;
+  uint32_t passStart = micros();
+  if (_loopStart != 0)
+  {
+    _note(_loopStat, passStart - _loopStart);
+  }
+  _loopStart = passStart | 1;
+  for (uint8_t idx = 0; idx < _taskCount; idx++)
+  {
+    schedTask_t &task = _tasks[idx];
+    if (_due(task, millis()))
+    {
+      _run(task);
+      ranAny = true;
+      if (task.priority > SCHEDULER_URGENT)
+      {
+        _runUrgent();
+      }
+    }
+  }
+  return ranAny;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::idle()
+{ // delay() lets the SDK and WiFi run and the CPU wait. Short, as ready checks only happen between sleeps
+  uint32_t idleStart = micros();
+  delay(SCHEDULER_IDLE_SLEEP);
+  _idleMicros += micros() - idleStart;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint8_t SchedulerClass::getIdlePercent()
+{
+  uint32_t sinceMillis = millis() - _idleSince;
+  if (sinceMillis == 0)
+  {
+    return 0;
+  }
+  return (uint8_t)((_idleMicros / 10) / sinceMillis);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool SchedulerClass::_due(schedTask_t &task, uint32_t now)
+{
+  if ((task.ready != NULL) && task.ready())
+  {
+    return true;
+  }
+  return (now - task.lastRun) >= task.period;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::_run(schedTask_t &task)
+{ // A task with input waiting keeps going while it has more, up to a burst, so a whole panel frame goes in one visit
+  trace.phase(task.phase);
+  uint32_t runStart = micros();
+  task.lastRun = millis();
+  uint8_t burst = SCHEDULER_READY_BURST;
+  do
+  {
+    task.run();
+    task.runs++;
+  } while ((task.ready != NULL) && (--burst > 0) && task.ready());
+  _note(task.stat, micros() - runStart);
+  trace.phase(PHASE_IDLE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::_runUrgent()
+{ // Urgent tasks sort first, so stop at the first that isn't
+  for (uint8_t idx = 0; (idx < _taskCount) && (_tasks[idx].priority <= SCHEDULER_URGENT); idx++)
+  {
+    if ((_tasks[idx].ready != NULL) && _tasks[idx].ready())
+    {
+      _run(_tasks[idx]);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::printStat(Print &out, const profStat_t &stat)
+{ // {"n":..,"minUs":..,"avgUs":..,"maxUs":..,"hist":[..]} with the histogram cut after its last non-zero bucket
+  out.print(F("{\"n\":")); out.print(stat.count);
+  out.print(F(",\"minUs\":")); out.print((stat.count > 0) ? stat.minUs : 0);
+  out.print(F(",\"avgUs\":")); out.print((stat.count > 0) ? (uint32_t)(stat.totalUs / stat.count) : 0);
+  out.print(F(",\"maxUs\":")); out.print(stat.maxUs);
+  out.print(F(",\"hist\":["));
+  uint8_t used = SCHEDULER_PROFILE_BUCKETS;
+  while ((used > 0) && (stat.buckets[used - 1] == 0))
+  {
+    used--;
+  }
+  for (uint8_t bucket = 0; bucket < used; bucket++)
+  {
+    if (bucket > 0)
+    {
+      out.print(F(","));
+    }
+    out.print(stat.buckets[bucket]);
+  }
+  out.print(F("]}"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::printProfile(Print &out)
+{ // {"loop":{..},"tasks":{"nextion":{..},..}}
+  out.print(F("{\"loop\":"));
+  printStat(out, _loopStat);
+  out.print(F(",\"tasks\":{"));
+  for (uint8_t idx = 0; idx < _taskCount; idx++)
+  {
+    if (idx > 0)
+    {
+      out.print(F(","));
+    }
+    out.print(F("\""));
+    out.print(_tasks[idx].name);
+    out.print(F("\":"));
+    printStat(out, _tasks[idx].stat);
+  }
+  out.print(F("}}"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::resetProfile()
+{
+  _clearStat(_loopStat);
+  _loopStart = 0;
+  for (uint8_t idx = 0; idx < _taskCount; idx++)
+  {
+    _clearStat(_tasks[idx].stat);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void SchedulerClass::_clearStat(profStat_t &stat)
+{
+  memset(&stat, 0, sizeof(stat));
+  stat.minUs = UINT32_MAX;
+}
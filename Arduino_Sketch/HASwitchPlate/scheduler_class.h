@@ -0,0 +1,128 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// scheduler_class.h : A small cooperative scheduler, so each part of loop() runs when it has work or its period is up
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+
+// This file is only #included once, mmkay
+#pragma once
+
+#include "settings.h"
+#include <Arduino.h>
+#include <Print.h>
+#include "trace_class.h"
+
+typedef void (*schedRun_t)(void);   // the work, usually someClass.loop()
+typedef bool (*schedReady_t)(void); // cheap test for waiting input, NULL for period only
+
+// Timing of one thing, in usec. Bucket n counts samples from 2^(n-1) to 2^n - 1 (bucket 0 is zero), the last bucket everything above
+typedef struct _prof_stat_struct {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t buckets[SCHEDULER_PROFILE_BUCKETS];
+} profStat_t;
+
+// One registered piece of loop() work
+typedef struct _sched_task_struct {
+  const char  *name;      // for the debug log
+  schedRun_t   run;
+  schedReady_t ready;     // run whenever this says there is input, as well as on the period
+  uint32_t     period;    // msec between runs when not ready, 0 runs every pass
+  uint8_t      priority;  // lower runs first. SCHEDULER_URGENT tasks also get a look in between the others
+  tracePhase_t phase;     // trace phase while it runs
+  uint32_t     lastRun;   // millis() at the last run
+  uint32_t     runs;      // times run since boot
+  profStat_t   stat;      // time per visit, a ready burst counts as one visit
+} schedTask_t;
+
+class SchedulerClass {
+private:
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // constructor
+  SchedulerClass(void) { _alive = false; _taskCount = 0; _idleMicros = 0; _idleSince = 0; _loopStart = 0; resetProfile(); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // destructor
+  ~SchedulerClass(void) { _alive = false; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void begin();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // register a task, kept in priority order. False when the table is full
+  bool add(const char *name, tracePhase_t phase, schedRun_t run, uint32_t period, uint8_t priority, schedReady_t ready = NULL);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // called in the main code loop, one pass over the task table. False if nothing was due
+  bool loop();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // nothing was due, give the CPU back for a moment rather than spin
+  void idle();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint8_t getTaskCount() { return _taskCount; }
+  inline const schedTask_t &getTask(uint8_t idx) { return _tasks[idx]; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // share of time since boot spent asleep with nothing to do, in percent
+  uint8_t getIdlePercent();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // the time from one pass of loop() to the next, idle sleep included. The worst gap between touch polls
+  inline const profStat_t &getLoopStat() { return _loopStat; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // JSON of one profStat_t, and of the loop and every task, for MQTT and http://plate01/api/profile
+  void printStat(Print &out, const profStat_t &stat);
+  void printProfile(Print &out);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void resetProfile();
+
+protected:
+  bool _alive;
+  schedTask_t _tasks[SCHEDULER_MAX_TASKS];
+  uint8_t _taskCount;
+  uint64_t _idleMicros;  // time spent in the idle delay()
+  uint32_t _idleSince;   // millis() at begin()
+  uint32_t _loopStart;   // micros() at the start of the last pass
+  profStat_t _loopStat;  // pass to pass period
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _due(schedTask_t &task, uint32_t now);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _run(schedTask_t &task);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _runUrgent();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // the hot path, a few compares and a count leading zeros
+  inline void _note(profStat_t &stat, uint32_t sampleUs)
+  {
+#if SCHEDULER_PROFILE_ENABLED==(true)
+    stat.count++;
+    stat.totalUs += sampleUs;
+    if (sampleUs < stat.minUs) { stat.minUs = sampleUs; }
+    if (sampleUs > stat.maxUs) { stat.maxUs = sampleUs; }
+    uint8_t bucket = (sampleUs == 0) ? 0 : (32 - __builtin_clz(sampleUs));
+    if (bucket >= SCHEDULER_PROFILE_BUCKETS) { bucket = SCHEDULER_PROFILE_BUCKETS - 1; }
+    stat.buckets[bucket]++;
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _clearStat(profStat_t &stat);
+};
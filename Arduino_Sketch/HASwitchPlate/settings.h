@@ -43,12 +43,20 @@
 #define CONNECTION_TIMEOUT (300)          // Timeout for WiFi and MQTT connection attempts in seconds
 #define RECONNECT_TIMEOUT (15)            // Timeout for WiFi reconnection attempts in seconds
 #define UPDATE_CHECK_INTERVAL (12*ANHOUR); // Time in msec between update checks (12 hours)
+#define UPDATE_CHECK_JITTER (ANHOUR)       // Up to this many msec are added at random to each update check interval
+#define UPDATE_CHECK_STARTUP_JITTER (5*AMINUTE) // The first update check after boot waits up to this many msec at random
+#define UPDATE_JSON_SIZE (1024)            // Document size for the filtered version.json (our ESP and panel keys only)
+#define UPDATE_CACHE_FILE "/update.json"   // SPIFFS path for the last version.json result and its ETag/Last-Modified
 
 // if your ESP is on an isolated network with no internet access, set UPDATE_CHECK_ENABLE false
 // and skip the attempts to connect to the live internet for an updated version, because
 // that connection will just fail. Note, brackets matter this time
 #define UPDATE_CHECK_ENABLE (true)  // if true, check The Internet for new versions
 
+// gzipped firmware images are inflated by the bootloader from ESP8266 core 2.7.0 (espressif8266@2.5.0).
+// This tree pins core 2.6.3, which rejects them, so only set this true after moving the platform up
+#define ESP_OTA_GZIP_ENABLED (false) // if true, update from the "firmwareGz" image in version.json when there is one. Needs core 2.7.0+
+
 // by default, on power on read config.json from the spiffs
 #define DISABLE_CONFIG_READ (false)  // if true, do not read config.json from spiffs
 
@@ -64,11 +72,73 @@
 #define NEXTION_CHECK_INTERVAL (5*ASECOND) // Time in msec between nextion connection checks
 #define NEXTION_RESET_PIN (D6)             // Pin for Nextion power rail switch (GPIO12/D6)
 #define NEXTION_CACHE_ENABLED (false)      // If true, cache Nextion Page Buttons in the ESP (eats RAM)
-
-#define MQTT_MAX_PACKET_SIZE (4096)             // Size of buffer for incoming MQTT message
+#define NEXTION_BAUD (115200)              // Normal rate of the LCD serial link
+#define NEXTION_OTA_MAX_BAUD (115200)      // Fastest rate to ask for during an LCD update, we step down if the panel won't ACK it. Only 115200 is proven on plate wiring
+#define NEXTION_OTA_RESTART_PARTS (2)      // A staged LCD update that fails within this many 4k parts starts again one rate lower
+#define NEXTION_OTA_BAUD_SETTLE (500)      // msec to wait after a refused rate before trying the next one down
+#define NEXTION_OTA_BUFFER_SIZE (1024)     // Each of the two TFT transfer buffers, malloc'd only during an LCD update
+#define NEXTION_OTA_TIMEOUT (30*ASECOND)   // Abort an LCD update when no TFT data has arrived for this long
+#define NEXTION_OTA_PROGRESS_INTERVAL (2*ASECOND) // Least time in msec between LCD update progress messages on hasp/<node>/lcdota
+#define NEXTION_OTA_STAGE_ENABLED (true)   // If true, download a TFT into SPIFFS and verify it before flashing the panel, when it fits
+#define NEXTION_OTA_STAGE_FILE "/lcd.tft"  // SPIFFS path for the staged TFT, removed once the panel has it
+#define NEXTION_OTA_STAGE_RESERVE (16384)  // Bytes of SPIFFS to leave free beyond the TFT, for filesystem overhead and config.json
+#define NEXTION_ACK_MODE (false)           // If true, ask the panel to answer every command (bkcmd=3) and time MQTT commands to that answer
+#define NEXTION_ACK_TIMEOUT (1000)         // msec after which a command that had no answer is given up on
+#define NEXTION_STREAM_MAX (8)             // Count of objects (sliders) that can stream .val while pressed
+#define NEXTION_STREAM_INTERVAL (100)      // Default time in msec between .val polls of a pressed streaming object
+#define NEXTION_GET_QUEUE (8)              // Count of get requests that can wait for the panel's reply at once
+#define NEXTION_GET_TIMEOUT (1000)         // Give up waiting for the reply to a get after this many msec
+
+#define MQTT_PACKET_SIZE (0)                    // Size of buffer for incoming MQTT message, 0 to size it from free heap at boot
+#define MQTT_MIN_PACKET_SIZE (1024)             // Smallest buffer for incoming MQTT message
+#define MQTT_MAX_PACKET_SIZE (4096)             // Largest buffer for incoming MQTT message when sized from free heap
+#define MQTT_PACKET_HEAP_DIVISOR (8)            // When sized from free heap, each of the two MQTT buffers gets 1/n of it
+#define MQTT_TLS_ENABLED (false)                // If true, connect to the broker with TLS (MQTTS, usually port 8883)
+#define DEFAULT_MQTT_FINGERPRINT ("")           // SHA1 fingerprint of the broker certificate for MQTTS, needed unless MQTT_TLS_INSECURE
+#define MQTT_TLS_INSECURE (false)               // If true, MQTTS without a fingerprint accepts any broker certificate. Otherwise it won't connect
+#define MQTT_TLS_FRAGMENT_SIZE (1024)           // TLS record size to negotiate with the broker (MFLN) to save heap, if it agrees
+#define MQTT_TLS_MFLN_UNKNOWN (0)               // Broker not probed for MFLN yet
+#define MQTT_TLS_MFLN_YES (1)                   // Broker agreed to MQTT_TLS_FRAGMENT_SIZE records
+#define MQTT_TLS_MFLN_NO (2)                    // Broker refused, use full size buffers
 #define MQTT_STATUS_UPDATE_INTERVAL (5*AMINUTE) // Time in msec between publishing MQTT status updates (5 minutes)
+#define MQTT_PERSISTENT_SESSION (false)         // If true, ask the broker to keep our session and queue QoS1 commands while we are away
+#define MQTT_SNAPSHOT_ENABLED (false)           // If true, restore retained panel attributes from hasp/<node>/snapshot/# at connect
+#define MQTT_SNAPSHOT_TIMEOUT (2*ASECOND)       // Longest time in msec to wait for retained snapshot messages at connect
+#define MQTT_SNAPSHOT_QUIET (250)               // Snapshot is complete once no message has arrived for this many msec
 
 #define MDNS_ENABLED (true)               // mDNS enabled
+#define MDNS_UPDATE_INTERVAL (100)        // Time in msec between mDNS housekeeping passes
+
+#define WEB_GATED_PARSE (true)            // If true, only parse an HTTP request once it has fully arrived, so slow clients cannot block loop(). Core 2.6.3 only
+#define WEB_BUFFERED_MAX (2048)           // Largest request we wait to have fully buffered before parsing. Keep under the TCP window
+#define WEB_CHUNK_SIZE (256)              // Dynamic page content is collected up to this many bytes before each chunk is sent
+#define WEB_HEAP_BUDGET (2048)            // Log a warning when a page view costs more than this many bytes of heap
+#define WEB_API_MAX_BODY (8192)           // Largest JSON command array accepted by /api/cmd
+#define WEBSOCKET_ENABLED (false)         // If true, serve the event and log stream. Needs the admin login (or the /events page token) when a password is set
+#define WEBSOCKET_PORT (81)               // Port for the WebSocket event and log stream
+#define WEBSOCKET_MAX_CLIENTS (3)         // Browsers that can watch the event stream at once
+#define WEBSOCKET_BUFFER_SIZE (1024)      // Bytes queued per WebSocket client, oldest events are dropped beyond this
+
+#define TRACE_ENABLED (true)              // If true, record UART, MQTT and loop phase events into a ring, fetched from /api/trace
+#define TRACE_RING_EVENTS (256)           // Events held, 8 bytes each. Must be a power of two
+#define TRACE_PHASE_MIN_US (1000)         // A loop phase with no events in it is only recorded if it ran at least this many usec
+#define TRACE_CRASH_LOG (true)            // If true, mirror the newest events and debug lines into RTC memory and publish them to hasp/<node>/postmortem after a reset
+#define TRACE_CRASH_EVENTS (16)           // Events kept in RTC memory, 8 bytes each
+#define TRACE_CRASH_LINES (3)             // Debug lines kept in RTC memory
+#define TRACE_CRASH_LINE_SIZE (64)        // Bytes kept of each of those lines. Must be a multiple of 4
+
+#define SCHEDULER_ENABLED (true)          // If true, loop() runs each part when it has input or its period is up. False runs everything every pass (the old way)
+#define SCHEDULER_MAX_TASKS (12)          // Size of the scheduler task table
+#define SCHEDULER_URGENT (0)              // Tasks of this priority or better get their ready check between every other task. Touch input lives here
+#define SCHEDULER_READY_BURST (16)        // Times a ready task may run back to back while it stays ready, one Nextion byte is one run
+#define SCHEDULER_IDLE_SLEEP (1)          // msec to delay() when a pass found nothing to do
+#define SCHEDULER_PROFILE_ENABLED (true)  // If true, keep run time statistics per task and for the loop period, on hasp/<node>/profile/# and /api/profile
+#define SCHEDULER_PROFILE_BUCKETS (20)    // Histogram buckets by powers of two of usec, the last holds everything from about 262msec up
+
+#define LATENCY_SAMPLES (64)              // Latest samples per path that percentiles are taken over
+#define LATENCY_TOUCH_SLO (100000)        // Target in usec from the first byte of a touch frame to its MQTT publish, slower ones are counted
+#define LATENCY_CMD_SLO (50000)           // Target in usec from an MQTT command arriving to its last byte leaving for the panel
+#define LATENCY_ACK_QUEUE (16)            // Panel commands that can wait for a reply at once, NEXTION_ACK_MODE only
 
 #define MOTION_ENABLED (false)            // Motion sensor is enabled
 #define MOTION_LATCH_TIMEOUT (30*ASECOND) // Latch time for motion sensor
@@ -82,5 +152,17 @@
 #define DEBUG_MQTT_VERBOSE (true)    // set false to have fewer printf from MQTT
 #define DEBUG_TELNET_ENABLED (false) // Enable telnet debug output
 #define DEBUG_SERIAL_ENABLED (true)  // Enable USB serial debug output
+#define DEBUG_COMPILED_SOURCES (0x0F) // Bit per source_t (1 HMI, 2 MQTT, 4 SYSTEM, 8 WIFI). DEBUG_PRINTLN() from a source not set here compiles to nothing
+#define DEBUG_LOG_ASYNC (true)       // If true, printLn() only copies into a ring that loop() drains. False writes every output inline (the old way)
+#define DEBUG_LOG_RING_SIZE (2048)   // Bytes of debug text held for outputs that haven't taken it yet
+#define DEBUG_LOG_STALL_MS (100)     // If loop() hasn't drained the ring for this long, printLn() writes inline so blocking waits still log
+#define DEBUG_SOFT_SERIAL_BUDGET (32) // Bytes bit-banged to the USB debug pin per loop() pass, about 2.8msec at 115200
+#define DEBUG_WEBSOCKET_LINES (4)    // Debug lines handed to the WebSocket per loop() pass
+#define DEFAULT_SYSLOG_SERVER ("")   // Syslog collector for debug output as "host" or "host:port", blank for none. Needs DEBUG_LOG_ASYNC
+#define DEBUG_SYSLOG_PORT (514)      // UDP port on the syslog collector when the server doesn't give one
+#define DEBUG_SYSLOG_PRI (135)       // RFC 5424 PRI of every message, facility local0 (16) * 8 + severity debug (7)
+#define DEBUG_SYSLOG_BATCH_SIZE (1024) // Largest datagram, header included. Lines are batched up to this
+#define DEBUG_SYSLOG_LINGER (250)    // msec a line may wait for others to share its datagram
+#define DEBUG_SYSLOG_RATE (10)       // Most datagrams per second, text beyond that waits in the ring and is dropped if it laps
 
 //#define FREE2(A) if( (A) != NULL ) { free(A); (A)=NULL;}
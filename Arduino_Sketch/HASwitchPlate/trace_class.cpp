@@ -0,0 +1,240 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// trace_class.cpp : Class internals for the binary event trace. Decode a snapshot with tools/hasp-trace.py
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+#include "common.h"
+
+extern "C"
+{
+#include <user_interface.h> // rst_info and the REASON_ codes
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::begin()
+{ // called in the main code setup, handles our initialisation
+  _alive = true;
+#if TRACE_ENABLED==(true)
+#if TRACE_CRASH_LOG==(true)
+  // see what the last boot left us before anything writes over it
+  _crashRead();
+  _crashInit();
+#endif
+  // time a burst of events so we know what tracing costs on this build and CPU clock
+  uint32_t costStart = micros();
+  for (uint8_t idx = 0; idx < 64; idx++)
+  {
+    event(TRACE_MARK, idx);
+  }
+  _eventNanos = ((micros() - costStart) * 1000) / 64;
+  clear();
+#if TRACE_CRASH_LOG==(true)
+  _crashInit(); // drop the timing burst from the RTC copy too
+#endif
+  debug.printLn(String(F("TRACE: ")) + String(TRACE_RING_EVENTS) + String(F(" event ring, ")) + String(_eventNanos) + String(F("ns per event")));
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint16_t TraceClass::_count()
+{ // events held since the last clear, at most a full ring
+  uint32_t held = _head - _start;
+  if (held > TRACE_RING_EVENTS)
+  {
+    held = TRACE_RING_EVENTS;
+  }
+  return held;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t TraceClass::getSnapshotSize()
+{ // the phase we are in now belongs in the snapshot, whether anything has happened in it yet or not
+  if (_phasePending)
+  {
+    _phaseFlush();
+  }
+  return sizeof(traceHeader_t) + (_count() * sizeof(traceEvent_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t TraceClass::writeTo(Client &client)
+{ // Send a snapshot. Nothing else runs while we write, so the ring can't move under us
+  traceHeader_t header;
+  memcpy(header.magic, "HTRC", 4);
+  header.version = 1;
+  header.eventSize = sizeof(traceEvent_t);
+  header.count = _count();
+  header.nowMicros = micros();
+  header.lost = (_head - _start) - header.count;
+  size_t written = client.write((const uint8_t *)&header, sizeof(header));
+
+  uint32_t first = (_head - header.count) & (TRACE_RING_EVENTS - 1);
+  uint16_t firstPart = TRACE_RING_EVENTS - first;
+  if (firstPart > header.count)
+  {
+    firstPart = header.count;
+  }
+  written += client.write((const uint8_t *)&_ring[first], firstPart * sizeof(traceEvent_t));
+  if (header.count > firstPart)
+  { // wrapped, the rest is at the start of the ring
+    written += client.write((const uint8_t *)&_ring[0], (header.count - firstPart) * sizeof(traceEvent_t));
+  }
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::clear()
+{
+  _start = _head;
+}
+
+// Keep in step with tracePhase_t
+static const char *const tracePhaseNames[] = {"idle", "nextion", "esp", "mqtt", "ota", "web", "websocket", "beep", "debug"};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::line(const String &text)
+{ // Only a prefix of each line fits, that's enough to know which path we were on
+#if TRACE_ENABLED==(true) && TRACE_CRASH_LOG==(true)
+  if (!_crashReady)
+  {
+    return;
+  }
+  char *slot = _crash.lines[_crash.lineHead];
+  strncpy(slot, text.c_str(), TRACE_CRASH_LINE_SIZE - 1);
+  slot[TRACE_CRASH_LINE_SIZE - 1] = '\0';
+  _crashWrite(slot, TRACE_CRASH_LINE_SIZE);
+  _crash.lineHead = (_crash.lineHead + 1) % TRACE_CRASH_LINES;
+  _crashWrite(&_crash.phase, 4);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::noteSoftReset()
+{
+#if TRACE_ENABLED==(true) && TRACE_CRASH_LOG==(true)
+  if (_crashReady)
+  {
+    _crash.softReset = 1;
+    _crashWrite(&_crash.phase, 4);
+  }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::_crashEvent(const traceEvent_t &event)
+{ // into the small event ring, then the status word with the new head
+  _crash.events[_crash.eventHead] = event;
+  _crashWrite(&_crash.events[_crash.eventHead], sizeof(traceEvent_t));
+  _crash.eventHead = (_crash.eventHead + 1) % TRACE_CRASH_EVENTS;
+  _crashWrite(&_crash.phase, 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::_crashPhase(uint8_t phase)
+{ // phase changes only move the phase byte
+  _crash.phase = phase;
+  _crashWrite(&_crash.phase, 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::_crashWrite(const void *field, size_t length)
+{ // copy a word aligned part of _crash to the same place in RTC memory
+  uint32_t offset = (const uint8_t *)field - (const uint8_t *)&_crash;
+  ESP.rtcUserMemoryWrite(TRACE_RTC_OFFSET + (offset / 4), (uint32_t *)field, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::_crashInit()
+{ // start a fresh log for this boot, keeping the boot count
+  uint32_t bootCount = _crash.bootCount;
+  memset(&_crash, 0, sizeof(_crash));
+  _crash.magic = TRACE_CRASH_MAGIC;
+  _crash.bootCount = bootCount;
+  ESP.rtcUserMemoryWrite(TRACE_RTC_OFFSET, (uint32_t *)&_crash, sizeof(_crash));
+  _crashReady = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TraceClass::_crashRead()
+{ // Turn whatever the last boot left in RTC memory into a post-mortem for MQTT
+  _crashReady = false;
+  _postMortem = String();
+  ESP.rtcUserMemoryRead(TRACE_RTC_OFFSET, (uint32_t *)&_crash, sizeof(_crash));
+  struct rst_info *resetInfo = ESP.getResetInfoPtr();
+  if ((_crash.magic != TRACE_CRASH_MAGIC) || (resetInfo->reason == REASON_DEFAULT_RST))
+  { // power on, RTC memory is noise
+    memset(&_crash, 0, sizeof(_crash));
+    _crash.bootCount = 1;
+    return;
+  }
+  _crash.bootCount++;
+  if ((_crash.phase >= (sizeof(tracePhaseNames) / sizeof(tracePhaseNames[0]))) ||
+      (_crash.eventHead >= TRACE_CRASH_EVENTS) || (_crash.lineHead >= TRACE_CRASH_LINES))
+  { // magic matched but the rest is half written, say so rather than guess
+    _postMortem = String(F("{\"reason\":\"")) + ESP.getResetReason() + String(F("\",\"bootCount\":")) + String(_crash.bootCount) + String(F(",\"damaged\":true}"));
+    return;
+  }
+
+  // 9 members, the line and event arrays and the strings copied into the pool: the F() keys, the reason,
+  // two hex addresses and the lines. A full log is about 1.7kB
+  String resetReason = ESP.getResetReason();
+  const size_t postMortemSize = JSON_OBJECT_SIZE(9) + JSON_ARRAY_SIZE(TRACE_CRASH_LINES) + JSON_ARRAY_SIZE(TRACE_CRASH_EVENTS) +
+                                (TRACE_CRASH_EVENTS * JSON_ARRAY_SIZE(4)) + (TRACE_CRASH_LINES * TRACE_CRASH_LINE_SIZE) +
+                                resetReason.length() + 1 + (2 * 12) + 96;
+  DynamicJsonDocument postMortemDoc(postMortemSize);
+  postMortemDoc[F("reason")] = resetReason;
+  postMortemDoc[F("softReset")] = (_crash.softReset != 0);
+  postMortemDoc[F("bootCount")] = _crash.bootCount;
+  postMortemDoc[F("phase")] = tracePhaseNames[_crash.phase];
+  if ((resetInfo->reason == REASON_EXCEPTION_RST) || (resetInfo->reason == REASON_WDT_RST) || (resetInfo->reason == REASON_SOFT_WDT_RST))
+  { // where the CPU was, decode with the .elf and xtensa-lx106-elf-addr2line
+    char hexText[12];
+    postMortemDoc[F("exccause")] = resetInfo->exccause;
+    snprintf_P(hexText, sizeof(hexText), PSTR("0x%08lx"), (unsigned long)resetInfo->epc1);
+    postMortemDoc[F("epc1")] = String(hexText);
+    snprintf_P(hexText, sizeof(hexText), PSTR("0x%08lx"), (unsigned long)resetInfo->excvaddr);
+    postMortemDoc[F("excvaddr")] = String(hexText);
+  }
+
+  // log lines oldest first, skipping slots we never filled
+  JsonArray lines = postMortemDoc.createNestedArray(F("lines"));
+  for (uint8_t idx = 0; idx < TRACE_CRASH_LINES; idx++)
+  {
+    char *slot = _crash.lines[(_crash.lineHead + idx) % TRACE_CRASH_LINES];
+    slot[TRACE_CRASH_LINE_SIZE - 1] = '\0';
+    if (slot[0] != '\0')
+    {
+      lines.add(String(slot));
+    }
+  }
+
+  // events oldest first as [id, arg8, arg16, usec before the newest event]
+  JsonArray events = postMortemDoc.createNestedArray(F("events"));
+  const traceEvent_t &newest = _crash.events[(_crash.eventHead + TRACE_CRASH_EVENTS - 1) % TRACE_CRASH_EVENTS];
+  for (uint8_t idx = 0; idx < TRACE_CRASH_EVENTS; idx++)
+  {
+    const traceEvent_t &event = _crash.events[(_crash.eventHead + idx) % TRACE_CRASH_EVENTS];
+    if (event.id == 0)
+    {
+      continue;
+    }
+    JsonArray entry = events.createNestedArray();
+    entry.add(event.id);
+    entry.add(event.arg8);
+    entry.add(event.arg16);
+    entry.add(newest.micros - event.micros);
+  }
+  if (postMortemDoc.overflowed())
+  { // should not happen with the sizing above, but a post-mortem missing its last moments would mislead
+    debug.printLn(String(F("TRACE: post-mortem did not fit in ")) + String(postMortemSize) + String(F(" bytes, newest events lost")));
+  }
+  serializeJson(postMortemDoc, _postMortem);
+  debug.printLn(String(F("TRACE: last reset was ")) + resetReason + String(F(" in phase ")) + String(tracePhaseNames[_crash.phase]) + (_crash.softReset ? String(F(" via esp.reset()")) : String()));
+}
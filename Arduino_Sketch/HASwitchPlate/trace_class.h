@@ -0,0 +1,218 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// trace_class.h : A compact binary event trace, for timing problems text debug is too slow to see
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+
+// This file is only #included once, mmkay
+#pragma once
+
+#include "settings.h"
+#include <Arduino.h>
+#include <stddef.h>
+#include <Client.h>
+
+// What happened. Keep in step with EVENT_NAMES in tools/hasp-trace.py
+enum trace_t : uint8_t {
+  TRACE_PHASE = 1, // arg8 = tracePhase_t, the phase runs until the next TRACE_PHASE
+  TRACE_UART_RX,   // arg8 = first byte of a Nextion frame, arg16 = frame length
+  TRACE_UART_TX,   // arg16 = command length, without the 0xFF suffix
+  TRACE_MQTT_IN,   // arg16 = payload length
+  TRACE_MQTT_OUT,  // arg16 = payload length
+  TRACE_MARK       // arg8 and arg16 free, for ad hoc digging
+};
+
+// Which part of loop() is running. Keep in step with PHASE_NAMES in tools/hasp-trace.py
+enum tracePhase_t : uint8_t {
+  PHASE_IDLE = 0,
+  PHASE_NEXTION,
+  PHASE_ESP,
+  PHASE_MQTT,
+  PHASE_OTA,
+  PHASE_WEB,
+  PHASE_WEBSOCKET,
+  PHASE_BEEP,
+  PHASE_DEBUG
+};
+
+// 8 bytes, written to the wire as-is (little endian)
+typedef struct _trace_event_struct {
+  uint32_t micros;
+  uint8_t  id;
+  uint8_t  arg8;
+  uint16_t arg16;
+} traceEvent_t;
+
+// leads each /api/trace snapshot
+typedef struct _trace_header_struct {
+  char     magic[4];   // "HTRC"
+  uint8_t  version;    // 1
+  uint8_t  eventSize;  // sizeof(traceEvent_t)
+  uint16_t count;      // events that follow, oldest first
+  uint32_t nowMicros;  // micros() when the snapshot was taken
+  uint32_t lost;       // events overwritten since the last clear
+} traceHeader_t;
+
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+
+// RTC user memory is 512 bytes that survive a reset (not a power cycle). The OTA bootloader
+// (eboot) keeps its command in the first 128, so the crash log starts past that
+#define TRACE_RTC_OFFSET (32)              // in 4 byte blocks
+#define TRACE_CRASH_MAGIC (0x48435231)     // "HCR1", bump when crashLog_t changes
+
+// The last moments before a reset, mirrored into RTC memory as they happen
+typedef struct _crash_log_struct {
+  uint32_t magic;       // TRACE_CRASH_MAGIC once we have initialised it
+  uint32_t bootCount;   // boots since power on
+  uint8_t  phase;       // tracePhase_t running when we went down
+  uint8_t  softReset;   // 1 if we went through esp.reset(), 0 for a crash or watchdog
+  uint8_t  eventHead;   // next events[] slot
+  uint8_t  lineHead;    // next lines[] slot
+  char     lines[TRACE_CRASH_LINES][TRACE_CRASH_LINE_SIZE];
+  traceEvent_t events[TRACE_CRASH_EVENTS];
+} crashLog_t;
+
+static_assert(sizeof(crashLog_t) <= (512 - (TRACE_RTC_OFFSET * 4)), "crashLog_t doesn't fit in RTC user memory");
+static_assert((offsetof(crashLog_t, phase) % 4) == 0, "crashLog_t status bytes must be word aligned");
+static_assert((TRACE_CRASH_LINE_SIZE % 4) == 0, "TRACE_CRASH_LINE_SIZE must be a multiple of 4");
+
+class TraceClass {
+private:
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // constructor
+  TraceClass(void) { _alive = false; _head = 0; _start = 0; _eventNanos = 0; _crashReady = false; _phasePending = false; _phase = PHASE_IDLE; _phaseStart = 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // destructor
+  ~TraceClass(void) { _alive = false; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void begin();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // the hot path. A micros() and four stores into the ring, then with TRACE_CRASH_LOG the same 8 bytes and
+  // the status word written through to RTC memory, which costs more than the rest. begin() logs the total
+  inline void event(uint8_t id, uint8_t arg8 = 0, uint16_t arg16 = 0)
+  {
+#if TRACE_ENABLED==(true)
+    if (_phasePending)
+    { // something happened in this phase, so it goes in the ring ahead of what happened
+      _phaseFlush();
+    }
+    traceEvent_t &slot = _store(micros(), id, arg8, arg16);
+#if TRACE_CRASH_LOG==(true)
+    if (_crashReady)
+    {
+      _crashEvent(slot);
+    }
+#endif
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // A phase only reaches the ring once an event happens inside it, or if it ran for TRACE_PHASE_MIN_US.
+  // Nine empty phases a pass would otherwise push the UART and MQTT events out of the ring in milliseconds.
+  // One that does get in is closed with a PHASE_IDLE mark, so the time of the skipped ones after it isn't
+  // counted as its own. The crash log always gets the phase, a watchdog needs to know where we were
+  inline void phase(tracePhase_t phase)
+  {
+#if TRACE_ENABLED==(true)
+    uint32_t now = micros();
+    if (_phasePending && ((now - _phaseStart) >= TRACE_PHASE_MIN_US))
+    { // nothing happened, but it took long enough to be worth seeing
+      _phaseFlush();
+    }
+    if (!_phasePending && (_phase != PHASE_IDLE))
+    { // it is in the ring, mark where it ended
+      _store(now, TRACE_PHASE, PHASE_IDLE, 0);
+    }
+    _phasePending = (phase != PHASE_IDLE); // idle is only ever stored as the end of something else
+    _phase = phase;
+    _phaseStart = now;
+#if TRACE_CRASH_LOG==(true)
+    if (_crashReady)
+    {
+      _crashPhase(phase);
+    }
+#endif
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // bytes writeTo() will send. Call it first, it puts the running phase in the ring
+  size_t getSnapshotSize();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // header then events, oldest first
+  size_t writeTo(Client &client);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void clear();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getEventNanos() { return _eventNanos; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // keep a debug line in the RTC crash log, the newest few say what we were doing
+  void line(const String &text);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // esp.reset() is on the way, so the post-mortem can tell a planned restart from a crash
+  void noteSoftReset();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // JSON description of the last reset, built once at begin(). Empty after a power on
+  inline bool hasPostMortem() { return _postMortem.length() > 0; }
+  inline const String &getPostMortem() { return _postMortem; }
+  inline void clearPostMortem() { _postMortem = String(); }
+
+protected:
+  bool _alive;
+  traceEvent_t _ring[TRACE_RING_EVENTS];
+  uint32_t _head;       // events ever recorded, the ring index is this masked
+  uint32_t _start;      // _head at the last clear()
+  uint32_t _eventNanos; // measured cost of one event() at begin()
+  crashLog_t _crash;    // RAM copy of the RTC crash log, we write through field by field
+  bool _crashReady;     // RTC crash log read and initialised, safe to write
+  String _postMortem;   // what the RTC crash log said at boot, until MQTT has sent it
+  bool _phasePending;   // _phase has started but isn't in the ring yet
+  uint8_t _phase;       // tracePhase_t running now
+  uint32_t _phaseStart; // micros() when _phase started
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline traceEvent_t &_store(uint32_t when, uint8_t id, uint8_t arg8, uint16_t arg16)
+  {
+    traceEvent_t &slot = _ring[_head & (TRACE_RING_EVENTS - 1)];
+    slot.micros = when;
+    slot.id = id;
+    slot.arg8 = arg8;
+    slot.arg16 = arg16;
+    _head++;
+    return slot;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline void _phaseFlush()
+  {
+    _store(_phaseStart, TRACE_PHASE, _phase, 0);
+    _phasePending = false;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  uint16_t _count();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _crashEvent(const traceEvent_t &event);
+  void _crashPhase(uint8_t phase);
+  void _crashRead();
+  void _crashInit();
+  void _crashWrite(const void *field, size_t length);
+};
@@ -13,13 +13,132 @@
 
 #include "common.h"
 #include <ESP8266WebServer.h>
+#include <core_version.h> // ARDUINO_ESP8266_RELEASE_2_6_3
 #include <ESP8266HTTPUpdateServer.h> // ESP8266HTTPUpdateServer, httpOTAUpdate
 #include <WiFiManager.h> // HTTP_HEADER, HTTP_END, etc
 #include <ESP8266mDNS.h> // MDNSResponder
+#include "web_static.h" // WEB_STATIC_CSS, WEB_STATIC_JS, generated by pio_script/gzip-static.py
 
 static const uint32_t telnetInputMax = 128;               // Size of user input buffer for user telnet session
 
-ESP8266WebServer webServer(80);            // Server listening for HTTP
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ESP8266WebServer reads a request with blocking reads once the first byte shows up, so a slow or
+// trickling client holds loop() (and with it the panel and MQTT) for up to its timeout.
+// This wrapper only lets the stock parser run once the whole request is sitting in the socket buffer,
+// so parsing it never waits on the network. A client that has not sent it all within HTTP_MAX_DATA_WAIT
+// is answered 408 and dropped, rather than handed to the blocking reads.
+// Not covered: a body bigger than WEB_BUFFERED_MAX can never all be buffered (the TCP window is ~2kB with
+// LWIP2_LOW_MEMORY), so it is read by the stock parser as it arrives. The same goes for multipart
+// uploads, which stream firmware to flash or the panel and end in a reset anyway.
+// The gate reaches into ESP8266WebServer's protected members, only checked against core 2.6.3.
+#if (WEB_GATED_PARSE==(true)) && !defined(ARDUINO_ESP8266_RELEASE_2_6_3)
+#warning "WEB_GATED_PARSE is only checked against ESP8266 core 2.6.3, building without it"
+#define WEB_GATE_ACTIVE (false)
+#else
+#define WEB_GATE_ACTIVE (WEB_GATED_PARSE)
+#endif
+
+class GatedWebServer : public ESP8266WebServer
+{
+public:
+  GatedWebServer(int port) : ESP8266WebServer(port) {}
+
+  void handleClient()
+  {
+#if WEB_GATE_ACTIVE==(true)
+    if (_currentStatus == HC_NONE)
+    { // accept here rather than in the base class, so the first bytes get the same gate as the rest
+      WiFiClient client = _server.available();
+      if (!client)
+      {
+        return;
+      }
+      _currentClient = client;
+      _currentStatus = HC_WAIT_READ;
+      _statusChange = millis();
+      return; // the request is rarely all here yet, look again next loop
+    }
+    if ((_currentStatus == HC_WAIT_READ) && _currentClient.connected() && !_requestBuffered())
+    {
+      if ((millis() - _statusChange) <= HTTP_MAX_DATA_WAIT)
+      { // still arriving, come back later rather than block reading it
+        return;
+      }
+      // it has had its time. The stock parser would only block on the rest, so give up on it here
+      _currentClient.print(F("HTTP/1.1 408 Request Timeout\r\nConnection: close\r\n\r\n"));
+      _currentClient.stop();
+      _currentClient = WiFiClient();
+      _currentStatus = HC_NONE;
+      return;
+    }
+#endif // WEB_GATE_ACTIVE
+    ESP8266WebServer::handleClient();
+  }
+
+protected:
+  bool _requestBuffered()
+  { // true once the whole request is buffered, or it is one we can't wait for (see above)
+    size_t available = _currentClient.available();
+    if (available == 0)
+    {
+      return false;
+    }
+    // never ask for more than is there, WiFiClient::peekBytes() waits up to its timeout for the rest.
+    // Only held for this look, so an idle server costs no RAM
+    size_t peekLength = min(available, (size_t)WEB_BUFFERED_MAX);
+    uint8_t *peekBuffer = (uint8_t *)malloc(peekLength);
+    if (peekBuffer == NULL)
+    { // no room to look, let the stock parser have it
+      return true;
+    }
+    size_t peeked = _currentClient.peekBytes(peekBuffer, peekLength);
+    size_t headerEnd = 0;
+    for (size_t idx = 3; idx < peeked; idx++)
+    {
+      if (peekBuffer[idx - 3] == '\r' && peekBuffer[idx - 2] == '\n' && peekBuffer[idx - 1] == '\r' && peekBuffer[idx] == '\n')
+      {
+        headerEnd = idx + 1;
+        break;
+      }
+    }
+    bool multipart = false;
+    size_t contentLength = 0;
+    if (headerEnd > 0)
+    {
+      multipart = (_findHeader(peekBuffer, headerEnd, "multipart/form-data") >= 0);
+      int lengthAt = _findHeader(peekBuffer, headerEnd, "content-length:");
+      if (lengthAt >= 0)
+      {
+        contentLength = atoi((const char *)&peekBuffer[lengthAt + 15]); // stops at the CR
+      }
+    }
+    free(peekBuffer);
+    if (headerEnd == 0)
+    { // either not all here, or headers longer than the window. In the second case let the stock parser have it
+      return (peeked >= WEB_BUFFERED_MAX);
+    }
+    if (multipart || ((headerEnd + contentLength) > WEB_BUFFERED_MAX))
+    { // uploads and big bodies are read by the stock parser as they come
+      return true;
+    }
+    return (available >= (headerEnd + contentLength));
+  }
+
+  int _findHeader(const uint8_t *buffer, size_t length, const char *needle)
+  { // case insensitive search, header names can come in any case
+    size_t needleLength = strlen(needle);
+    for (size_t idx = 0; idx + needleLength <= length; idx++)
+    {
+      if (strncasecmp((const char *)&buffer[idx], needle, needleLength) == 0)
+      {
+        return idx;
+      }
+    }
+    return -1;
+  }
+};
+
+GatedWebServer webServer(80);              // Server listening for HTTP
 ESP8266HTTPUpdateServer httpOTAUpdate;
 WiFiServer telnetServer(23);               // Server listening for Telnet
 WiFiClient telnetClient;
@@ -87,6 +206,42 @@ void callback_HandleReboot()
 {
   web._handleReboot();
 }
+void callback_HandleEvents()
+{
+  web._handleEvents();
+}
+void callback_HandleApiStatus()
+{
+  web._handleApiStatus();
+}
+void callback_HandleApiCmd()
+{
+  web._handleApiCmd();
+}
+void callback_HandleApiCache()
+{
+  web._handleApiCache();
+}
+void callback_HandleApiTrace()
+{
+  web._handleApiTrace();
+}
+void callback_HandleApiProfile()
+{
+  web._handleApiProfile();
+}
+void callback_HandleApiLatency()
+{
+  web._handleApiLatency();
+}
+void callback_HandleStaticCss()
+{
+  web._handleStatic(WEB_STATIC_CSS, sizeof(WEB_STATIC_CSS), PSTR("text/css"), WEB_STATIC_CSS_ETAG);
+}
+void callback_HandleStaticJs()
+{
+  web._handleStatic(WEB_STATIC_JS, sizeof(WEB_STATIC_JS), PSTR("application/javascript"), WEB_STATIC_JS_ETAG);
+}
 // end callbacks
 
 
@@ -119,10 +274,17 @@ void WebClass::loop()
   {
     begin();
   }
+  uint32_t webLoopStart = micros();
   webServer.handleClient(); // webServer loop
+  uint32_t webLoopTime = micros() - webLoopStart;
+  if (webLoopTime > _webLoopMaxMicros)
+  { // worst case time we held up the rest of loop(), to compare WEB_GATED_PARSE on and off
+    _webLoopMaxMicros = webLoopTime;
+  }
 
-  if (config.getMDNSEnabled())
-  {
+  if (config.getMDNSEnabled() && ((millis() - _mdnsUpdateTimer) >= MDNS_UPDATE_INTERVAL))
+  { // queries are answered from here, a tenth of a second is plenty
+    _mdnsUpdateTimer = millis();
     MDNS.update();
   }
 
@@ -155,7 +317,18 @@ void WebClass::_setupHTTP()
   webServer.on("/lcdOtaSuccess", callback_HandleLcdUpdateSuccess);
   webServer.on("/lcdOtaFailure", callback_HandleLcdUpdateFailure);
   webServer.on("/reboot", callback_HandleReboot);
+  webServer.on("/events", callback_HandleEvents);
+  webServer.on("/api/status", callback_HandleApiStatus);
+  webServer.on("/api/cmd", callback_HandleApiCmd);
+  webServer.on("/api/cache", callback_HandleApiCache);
+  webServer.on("/api/trace", callback_HandleApiTrace);
+  webServer.on("/api/profile", callback_HandleApiProfile);
+  webServer.on("/api/latency", callback_HandleApiLatency);
+  webServer.on("/hasp.css", callback_HandleStaticCss);
+  webServer.on("/hasp.js", callback_HandleStaticJs);
   webServer.onNotFound(callback_HandleNotFound);
+  const char *headerKeys[] = {"If-None-Match"}; // the server drops request headers we do not ask for
+  webServer.collectHeaders(headerKeys, 1);
   webServer.begin();
   debug.printLn(String(F("HTTP: Server started @ http://")) + WiFi.localIP().toString());
 }
@@ -251,6 +424,28 @@ void WebClass::telnetPrint(bool enabled, String message)
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool WebClass::telnetConnected(bool enabled)
+{
+  return enabled && telnetClient.connected();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t WebClass::telnetAvailableForWrite(bool enabled)
+{ // how much the TCP send buffer will take without waiting for an ACK
+  if (!telnetConnected(enabled))
+  {
+    return 0;
+  }
+  return telnetClient.availableForWrite();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::telnetWrite(const uint8_t *buffer, size_t size)
+{
+  telnetClient.write(buffer, size);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 bool WebClass::_authenticated(void)
 { // common code to verify our authentication on most handle callbacks
@@ -266,6 +461,256 @@ bool WebClass::_authenticated(void)
   return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webBegin(int code, const char *contentType)
+{ // Begin a chunked response of any type, and start counting the heap it costs
+  _webHeapStart = ESP.getFreeHeap();
+  _webHeapLow = _webHeapStart;
+  _webChunk = "";
+  _webChunk.reserve(WEB_CHUNK_SIZE + 64); // kept between pages so the heap does not fragment around it
+
+  webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webServer.send(code, contentType, "");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webStart(const String &title, bool styled)
+{ // Begin a chunked text/html response and send the common page head, straight from PROGMEM where we can
+  _webBegin(200, "text/html");
+
+  String pageHeader = FPSTR(HTTP_HEADER); // small, and the only fragment that needs a substitution
+  pageHeader.replace("{v}", title);
+  webServer.sendContent(pageHeader);
+  if (styled)
+  { // style and script are cached by the browser, see _handleStatic()
+    _webSend(F("<link rel='stylesheet' href='/hasp.css'><script src='/hasp.js' defer></script>"));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webSend(const String &fragment)
+{ // Queue a small dynamic fragment, sending a chunk once enough has been collected
+  _webChunk += fragment;
+  if (_webChunk.length() >= WEB_CHUNK_SIZE)
+  {
+    _webFlush();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webSend(const __FlashStringHelper *fragment)
+{ // As above, but copied straight out of flash without a temporary String
+  _webChunk += fragment;
+  if (_webChunk.length() >= WEB_CHUNK_SIZE)
+  {
+    _webFlush();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webSend(const char *fragment)
+{
+  _webChunk += fragment;
+  if (_webChunk.length() >= WEB_CHUNK_SIZE)
+  {
+    _webFlush();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t WebClass::write(uint8_t character)
+{ // Print interface, so other classes can stream straight into the current response
+  _webChunk += char(character);
+  if (_webChunk.length() >= WEB_CHUNK_SIZE)
+  {
+    _webFlush();
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t WebClass::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t idx = 0; idx < size; idx++)
+  {
+    write(buffer[idx]);
+  }
+  return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webSend_P(PGM_P fragment)
+{ // Large PROGMEM fragments go out as their own chunk, never copied to the heap
+  _webFlush();
+  webServer.sendContent_P(fragment);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webFlush()
+{
+  uint32_t heapNow = ESP.getFreeHeap();
+  if (heapNow < _webHeapLow)
+  {
+    _webHeapLow = heapNow;
+  }
+  if (_webChunk.length() > 0)
+  {
+    webServer.sendContent(_webChunk);
+    _webChunk = "";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webEnd()
+{ // Send the page footer and close the page
+  _webSend_P(HTTP_END);
+  _webFinish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_webFinish()
+{ // Close the chunked response and account for the heap it cost us
+  _webFlush();
+  webServer.sendContent(""); // zero length chunk ends the response
+
+  _webLastCost = _webHeapStart - _webHeapLow;
+  if (_webLastCost > _webPeakCost)
+  {
+    _webPeakCost = _webLastCost;
+  }
+  if (_webLastCost > WEB_HEAP_BUDGET)
+  {
+    debug.printLn(String(F("HTTP: [WARNING] ")) + webServer.uri() + String(F(" cost ")) + String(_webLastCost) + String(F(" bytes of heap")));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleStatic(const uint8_t *content, size_t contentLength, PGM_P contentType, const char *etag)
+{ // http://plate01/hasp.css and friends, pre-gzipped in PROGMEM. No authentication, there is nothing secret here
+  if (webServer.header("If-None-Match") == etag)
+  { // browser already has this exact version. RFC 7232 wants the ETag on the 304 too
+    webServer.sendHeader("ETag", etag);
+    webServer.sendHeader("Cache-Control", "no-cache");
+    webServer.send(304);
+    return;
+  }
+  webServer.sendHeader("Content-Encoding", "gzip");
+  webServer.sendHeader("ETag", etag);
+  webServer.sendHeader("Cache-Control", "no-cache"); // always revalidate, costs a 304 and no body
+  webServer.send_P(200, contentType, (PGM_P)content, contentLength);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleEvents()
+{ // http://plate01/events
+  if( !_authenticated() ) { return; }
+
+  debug.printLn(String(F("HTTP: Sending /events page to client connected from: ")) + webServer.client().remoteIP().toString());
+  _webStart(String(config.getHaspNode()) + " events");
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F(" events</h1>")));
+  if (websocket.getEnabled())
+  {
+    _webSend(String(F("<pre id='wsLog' style='text-align:left' data-port='")) + String(WEBSOCKET_PORT) + String(F("' data-token='")) + String(websocket.getToken()) + String(F("'></pre>")));
+  }
+  else
+  {
+    _webSend(F("<br/>The event stream is off. Set WEBSOCKET_ENABLED in settings.h to use it.<br/>"));
+  }
+  _webSend(F("<hr><form method='get' action='/'><button type='submit'>return home</button></form>"));
+  _webEnd();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiStatus()
+{ // http://plate01/api/status
+  if( !_authenticated() ) { return; }
+
+  _webBegin(200, "application/json");
+  mqtt.printStatus(*this);
+  _webFinish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiCmd()
+{ // http://plate01/api/cmd -d '["dim=50","page 1"]' = nextion.parseJson() just like '[...]/device/command/json'
+  if( !_authenticated() ) { return; }
+
+  if (webServer.method() != HTTP_POST)
+  {
+    webServer.send(405, "application/json", "{\"error\":\"POST a JSON array of commands\"}");
+    return;
+  }
+  String jsonPayload = webServer.arg("plain"); // ESP8266WebServer hands us the body as "plain"
+  if (jsonPayload.length() > WEB_API_MAX_BODY)
+  {
+    webServer.send(413, "application/json", "{\"error\":\"too many commands, split them up\"}");
+    return;
+  }
+  debug.printLn(String(F("HTTP: /api/cmd ")) + String(jsonPayload.length()) + String(F(" bytes from ")) + webServer.client().remoteIP().toString());
+  int16_t cmdCount = nextion.parseJson(jsonPayload);
+  if (cmdCount < 0)
+  {
+    webServer.send(400, "application/json", "{\"error\":\"could not parse JSON array\"}");
+    return;
+  }
+  webServer.send(200, "application/json", String(F("{\"commands\":")) + String(cmdCount) + String(F("}")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiCache()
+{ // http://plate01/api/cache
+  if( !_authenticated() ) { return; }
+
+  _webBegin(200, "application/json");
+  nextion.printCache(*this);
+  _webFinish();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiTrace()
+{ // http://plate01/api/trace[?clear=1]  binary snapshot of the trace ring, decode with tools/hasp-trace.py
+  if( !_authenticated() ) { return; }
+
+  webServer.sendHeader(F("Cache-Control"), F("no-store"));
+  webServer.setContentLength(trace.getSnapshotSize());
+  webServer.send(200, "application/octet-stream", "");
+  WiFiClient traceClient = webServer.client();
+  trace.writeTo(traceClient);
+  if (webServer.arg(F("clear")) == "1")
+  {
+    trace.clear();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiProfile()
+{ // http://plate01/api/profile[?reset=1]  loop period and per task run time statistics
+  if( !_authenticated() ) { return; }
+
+  _webBegin(200, "application/json");
+  scheduler.printProfile(*this);
+  _webFinish();
+  if (webServer.arg(F("reset")) == "1")
+  {
+    scheduler.resetProfile();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebClass::_handleApiLatency()
+{ // http://plate01/api/latency[?reset=1]  end to end latency percentiles
+  if( !_authenticated() ) { return; }
+
+  _webBegin(200, "application/json");
+  latency.printLatency(*this);
+  _webFinish();
+  if (webServer.arg(F("reset")) == "1")
+  {
+    latency.reset();
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void WebClass::_handleNotFound()
 { // webServer 404
@@ -291,124 +736,163 @@ void WebClass::_handleRoot()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending root page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", String(config.getHaspNode()));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>"));
-  httpMessage += String(config.getHaspNode());
-  httpMessage += String(F("</h1>"));
-
-  httpMessage += String(F("<form method='POST' action='saveConfig'>"));
-  httpMessage += String(F("<b>WiFi SSID</b> <i><small>(required)</small></i><input id='wifiSSID' required name='wifiSSID' maxlength=32 placeholder='WiFi SSID' value='")) + String(WiFi.SSID()) + "'>";
-  httpMessage += String(F("<br/><b>WiFi Password</b> <i><small>(required)</small></i><input id='wifiPass' required name='wifiPass' type='password' maxlength=64 placeholder='WiFi Password' value='")) + String("********") + "'>";
-  httpMessage += String(F("<br/><br/><b>HASP Node Name</b> <i><small>(required. lowercase letters, numbers, and _ only)</small></i><input id='haspNode' required name='haspNode' maxlength=15 placeholder='HASP Node Name' pattern='[a-z0-9_]*' value='")) + String(config.getHaspNode()) + "'>";
-  httpMessage += String(F("<br/><br/><b>Group Name</b> <i><small>(required)</small></i><input id='groupName' required name='groupName' maxlength=15 placeholder='Group Name' value='")) + String(config.getGroupName()) + "'>";
-  httpMessage += String(F("<br/><br/><b>MQTT Broker</b> <i><small>(required)</small></i><input id='mqttServer' required name='mqttServer' maxlength=63 placeholder='mqttServer' value='")) + String(config.getMQTTServer()) + "'>";
-  httpMessage += String(F("<br/><b>MQTT Port</b> <i><small>(required)</small></i><input id='mqttPort' required name='mqttPort' type='number' maxlength=5 placeholder='mqttPort' value='")) + String(config.getMQTTPort()) + "'>";
-  httpMessage += String(F("<br/><b>MQTT User</b> <i><small>(optional)</small></i><input id='mqttUser' name='mqttUser' maxlength=31 placeholder='mqttUser' value='")) + String(config.getMQTTUser()) + "'>";
-  httpMessage += String(F("<br/><b>MQTT Password</b> <i><small>(optional)</small></i><input id='mqttPassword' name='mqttPassword' type='password' maxlength=31 placeholder='mqttPassword' value='"));
+  _webStart(String(config.getHaspNode()));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(F("<h1>"));
+  _webSend(String(config.getHaspNode()));
+  _webSend(F("</h1>"));
+
+  _webSend(F("<form method='POST' action='saveConfig'>"));
+  _webSend(String(F("<b>WiFi SSID</b> <i><small>(required)</small></i><input id='wifiSSID' required name='wifiSSID' maxlength=32 placeholder='WiFi SSID' value='")) + String(WiFi.SSID()) + "'>");
+  _webSend(String(F("<br/><b>WiFi Password</b> <i><small>(required)</small></i><input id='wifiPass' required name='wifiPass' type='password' maxlength=64 placeholder='WiFi Password' value='")) + String("********") + "'>");
+  _webSend(String(F("<br/><br/><b>HASP Node Name</b> <i><small>(required. lowercase letters, numbers, and _ only)</small></i><input id='haspNode' required name='haspNode' maxlength=15 placeholder='HASP Node Name' pattern='[a-z0-9_]*' value='")) + String(config.getHaspNode()) + "'>");
+  _webSend(String(F("<br/><br/><b>Group Name</b> <i><small>(required)</small></i><input id='groupName' required name='groupName' maxlength=15 placeholder='Group Name' value='")) + String(config.getGroupName()) + "'>");
+  _webSend(String(F("<br/><br/><b>MQTT Broker</b> <i><small>(required)</small></i><input id='mqttServer' required name='mqttServer' maxlength=63 placeholder='mqttServer' value='")) + String(config.getMQTTServer()) + "'>");
+  _webSend(String(F("<br/><b>MQTT Port</b> <i><small>(required)</small></i><input id='mqttPort' required name='mqttPort' type='number' maxlength=5 placeholder='mqttPort' value='")) + String(config.getMQTTPort()) + "'>");
+  _webSend(String(F("<br/><b>MQTT User</b> <i><small>(optional)</small></i><input id='mqttUser' name='mqttUser' maxlength=31 placeholder='mqttUser' value='")) + String(config.getMQTTUser()) + "'>");
+  _webSend(F("<br/><b>MQTT Password</b> <i><small>(optional)</small></i><input id='mqttPassword' name='mqttPassword' type='password' maxlength=31 placeholder='mqttPassword' value='"));
   if (strlen(config.getMQTTPassword()) != 0)
   {
-    httpMessage += String("********");
+    _webSend(String("********"));
   }
-  httpMessage += String(F("'><br/><br/><b>HASP Admin Username</b> <i><small>(optional)</small></i><input id='configUser' name='configUser' maxlength=31 placeholder='Admin User' value='")) + String(_configUser) + "'>";
-  httpMessage += String(F("<br/><b>HASP Admin Password</b> <i><small>(optional)</small></i><input id='configPassword' name='configPassword' type='password' maxlength=31 placeholder='Admin User Password' value='"));
+  _webSend(String(F("'><br/><b>MQTT Buffer Size</b> <i><small>(optional, 0 to size from free heap, or ")) + String(MQTT_MIN_PACKET_SIZE) + String(F(" to ")) + String(MQTT_MAX_PACKET_SIZE) + String(F(")</small></i><input id='mqttBufferSize' name='mqttBufferSize' type='number' min=0 max=")) + String(MQTT_MAX_PACKET_SIZE) + String(F(" maxlength=5 placeholder='0' value='")) + String(config.getMQTTBufferSize()));
+  _webSend(F("'><br/><b>MQTT TLS</b> <i><small>(optional)</small></i><input id='mqttTls' name='mqttTls' type='checkbox'"));
+  if (config.getMQTTTls())
+  {
+    _webSend(F(" checked='checked'"));
+  }
+  _webSend(String(F("><br/><b>MQTT TLS Fingerprint</b> <i><small>(SHA1 of broker certificate, required for TLS unless insecure below)</small></i><input id='mqttFingerprint' name='mqttFingerprint' maxlength=59 placeholder='AA:BB:CC:...' value='")) + String(config.getMQTTFingerprint()));
+  _webSend(F("'><br/><b>MQTT TLS Insecure</b> <i><small>(accept any broker certificate when there is no fingerprint)</small></i><input id='mqttTlsInsecure' name='mqttTlsInsecure' type='checkbox'"));
+  if (config.getMQTTTlsInsecure())
+  {
+    _webSend(F(" checked='checked'"));
+  }
+  _webSend(String(F("><br/><br/><b>HASP Admin Username</b> <i><small>(optional)</small></i><input id='configUser' name='configUser' maxlength=31 placeholder='Admin User' value='")) + String(_configUser) + "'>");
+  _webSend(F("<br/><b>HASP Admin Password</b> <i><small>(optional)</small></i><input id='configPassword' name='configPassword' type='password' maxlength=31 placeholder='Admin User Password' value='"));
   if (strlen(_configPassword) != 0)
   {
-    httpMessage += String("********");
+    _webSend(String("********"));
   }
-  httpMessage += String(F("'><br/><hr><b>Motion Sensor Pin:&nbsp;</b><select id='motionPinConfig' name='motionPinConfig'>"));
-  httpMessage += String(F("<option value='0'"));
+  _webSend(F("'><br/><hr><b>Motion Sensor Pin:&nbsp;</b><select id='motionPinConfig' name='motionPinConfig'>"));
+  _webSend(F("<option value='0'"));
   if (!esp.getMotionPin())
   {
-    httpMessage += String(F(" selected"));
+    _webSend(F(" selected"));
   }
-  httpMessage += String(F(">disabled/not installed</option><option value='D0'"));
+  _webSend(F(">disabled/not installed</option><option value='D0'"));
   if (esp.getMotionPin() == D0)
   {
-    httpMessage += String(F(" selected"));
+    _webSend(F(" selected"));
   }
-  httpMessage += String(F(">D0</option><option value='D1'"));
+  _webSend(F(">D0</option><option value='D1'"));
   if (esp.getMotionPin() == D1)
   {
-    httpMessage += String(F(" selected"));
+    _webSend(F(" selected"));
   }
-  httpMessage += String(F(">D1</option></select>"));
+  _webSend(F(">D1</option></select>"));
 
-  httpMessage += String(F("<br/><b>Serial debug output enabled:</b><input id='debugSerialEnabled' name='debugSerialEnabled' type='checkbox'"));
+  _webSend(F("<br/><b>Serial debug output enabled:</b><input id='debugSerialEnabled' name='debugSerialEnabled' type='checkbox'"));
   if (debug.getSerialEnabled())
   {
-    httpMessage += String(F(" checked='checked'"));
+    _webSend(F(" checked='checked'"));
   }
-  httpMessage += String(F("><br/><b>Telnet debug output enabled:</b><input id='debugTelnetEnabled' name='debugTelnetEnabled' type='checkbox'"));
+  _webSend(F("><br/><b>Telnet debug output enabled:</b><input id='debugTelnetEnabled' name='debugTelnetEnabled' type='checkbox'"));
   if (debug.getTelnetEnabled())
   {
-    httpMessage += String(F(" checked='checked'"));
+    _webSend(F(" checked='checked'"));
   }
-  httpMessage += String(F("><br/><b>mDNS enabled:</b><input id='mdnsEnabled' name='mdnsEnabled' type='checkbox'"));
+  _webSend(String(F("><br/><b>Syslog server</b> <i><small>(optional, host or host:port, UDP port ")) + String(DEBUG_SYSLOG_PORT) + String(F(" by default)</small></i><input id='debugSyslogServer' name='debugSyslogServer' maxlength=63 placeholder='syslog server' value='")) + String(debug.getSyslogServer()) + "'");
+  _webSend(F("><br/><b>mDNS enabled:</b><input id='mdnsEnabled' name='mdnsEnabled' type='checkbox'"));
   if (config.getMDNSEnabled())
   {
-    httpMessage += String(F(" checked='checked'"));
+    _webSend(F(" checked='checked'"));
   }
 
-  httpMessage += String(F("><br/><b>Keypress beep enabled:</b><input id='beepEnabled' name='beepEnabled' type='checkbox'"));
+  _webSend(F("><br/><b>MQTT persistent session:</b><input id='mqttPersistent' name='mqttPersistent' type='checkbox'"));
+  if (config.getMQTTPersistent())
+  {
+    _webSend(F(" checked='checked'"));
+  }
+
+  _webSend(F("><br/><b>MQTT restore retained snapshot:</b><input id='mqttSnapshot' name='mqttSnapshot' type='checkbox'"));
+  if (config.getMQTTSnapshot())
+  {
+    _webSend(F(" checked='checked'"));
+  }
+
+  _webSend(F("><br/><b>Keypress beep enabled:</b><input id='beepEnabled' name='beepEnabled' type='checkbox'"));
   if (beep.getEnable())
   {
-    httpMessage += String(F(" checked='checked'"));
+    _webSend(F(" checked='checked'"));
   }
 
-  httpMessage += String(F("><br/><hr><button type='submit'>save settings</button></form>"));
+  _webSend(F("><br/><hr><button type='submit'>save settings</button></form>"));
 
   if (config.isEspUpdateAvailable())
   {
-    httpMessage += String(F("<br/><hr><font color='green'><center><h3>HASP Update available!</h3></center></font>"));
-    httpMessage += String(F("<form method='get' action='espfirmware'>"));
-    httpMessage += String(F("<input id='espFirmwareURL' type='hidden' name='espFirmware' value='")) + config.getEspFirmwareUrl() + "'>";
-    httpMessage += String(F("<button type='submit'>update HASP to v")) + String(config.getEspAvailableVersion()) + String(F("</button></form>"));
+    _webSend(F("<br/><hr><font color='green'><center><h3>HASP Update available!</h3></center></font>"));
+    _webSend(F("<form method='get' action='espfirmware'>"));
+    _webSend(String(F("<input id='espFirmwareURL' type='hidden' name='espFirmware' value='")) + config.getEspFirmwareUrl() + "'>");
+    _webSend(String(F("<button type='submit'>update HASP to v")) + String(config.getEspAvailableVersion()) + String(F("</button></form>")));
   }
 
-  httpMessage += String(F("<hr><form method='get' action='firmware'>"));
-  httpMessage += String(F("<button type='submit'>update firmware</button></form>"));
+  _webSend(F("<hr><form method='get' action='firmware'>"));
+  _webSend(F("<button type='submit'>update firmware</button></form>"));
 
-  httpMessage += String(F("<hr><form method='get' action='reboot'>"));
-  httpMessage += String(F("<button type='submit'>reboot device</button></form>"));
+  _webSend(F("<hr><form method='get' action='events'>"));
+  _webSend(F("<button type='submit'>live events</button></form>"));
 
-  httpMessage += String(F("<hr><form method='get' action='resetBacklight'>"));
-  httpMessage += String(F("<button type='submit'>reset lcd backlight</button></form>"));
+  _webSend(F("<hr><form method='get' action='reboot'>"));
+  _webSend(F("<button type='submit'>reboot device</button></form>"));
 
-  httpMessage += String(F("<hr><form method='get' action='resetConfig'>"));
-  httpMessage += String(F("<button type='submit'>factory reset settings</button></form>"));
+  _webSend(F("<hr><form method='get' action='resetBacklight'>"));
+  _webSend(F("<button type='submit'>reset lcd backlight</button></form>"));
 
-  httpMessage += String(F("<hr><b>MQTT Status: </b>"));
+  _webSend(F("<hr><form method='get' action='resetConfig'>"));
+  _webSend(F("<button type='submit'>factory reset settings</button></form>"));
+
+  _webSend(F("<hr><b>MQTT Status: </b>"));
   if (mqtt.clientIsConnected())
   { // Check MQTT connection
-    httpMessage += String(F("Connected"));
+    _webSend(F("Connected"));
   }
   else
   {
-    httpMessage += String(F("<font color='red'><b>Disconnected</b></font>, return code: ")) + mqtt.clientReturnCode();
+    _webSend(String(F("<font color='red'><b>Disconnected</b></font>, return code: ")) + mqtt.clientReturnCode());
+  }
+  _webSend(String(F("<br/><b>MQTT ClientID: </b>")) + mqtt.getClientID());
+  _webSend(String(F("<br/><b>MQTT Connect: </b>")) + String(mqtt.getConnectMillis()) + String(F("ms, heap cost ")) + String(mqtt.getConnectHeap()));
+  if (config.getMQTTTls())
+  {
+    _webSend(F(" (TLS)"));
+  }
+  _webSend(String(F("<br/><b>MQTT Buffer: </b>")) + String(mqtt.getMaxPacketSize()) + String(F(" bytes, largest packet ")) + String(mqtt.getLargestPacket()) + String(F(", oversize ")) + String(mqtt.getOversizeCount()));
+  _webSend(String(F("<br/><b>WebSocket Clients: </b>")) + String(websocket.getClientCount()) + String(F(", dropped events ")) + String(websocket.getDroppedCount()));
+  _webSend(String(F("<br/><b>HASP Version: </b>")) + String(config.getHaspVersion()));
+  _webSend(String(F("<br/><b>LCD Model: </b>")) + String(nextion.getModel()));
+  _webSend(String(F("<br/><b>LCD Version: </b>")) + String(nextion.getLCDVersion()));
+  _webSend(String(F("<br/><b>LCD Active Page: </b>")) + String(nextion.getActivePage()));
+  _webSend(String(F("<br/><b>CPU Frequency: </b>")) + String(ESP.getCpuFreqMHz()) + String(F("MHz")));
+  _webSend(String(F("<br/><b>Sketch Size: </b>")) + String(ESP.getSketchSize()) + String(F(" bytes")));
+  _webSend(String(F("<br/><b>Free Sketch Space: </b>")) + String(ESP.getFreeSketchSpace()) + String(F(" bytes")));
+  _webSend(String(F("<br/><b>Heap Free: </b>")) + String(ESP.getFreeHeap()));
+  _webSend(String(F("<br/><b>Heap Fragmentation: </b>")) + String(ESP.getHeapFragmentation()));
+  _webSend(String(F("<br/><b>ESP core version: </b>")) + String(ESP.getCoreVersion()));
+  _webSend(String(F("<br/><b>IP Address: </b>")) + String(WiFi.localIP().toString()));
+  _webSend(String(F("<br/><b>Signal Strength: </b>")) + String(WiFi.RSSI()));
+  _webSend(String(F("<br/><b>Uptime: </b>")) + String(int32_t(millis() / 1000)));
+  _webSend(String(F("<br/><b>Loop Latency: </b>")) + String(esp.getLoopMaxMicros() / 1000) + String(F("ms worst, ")) + String(_webLoopMaxMicros / 1000) + String(F("ms in HTTP, ")) + String(scheduler.getIdlePercent()) + String(F("% idle")));
+  _webSend(String(F("<br/><b>Touch to MQTT: </b>")) + String(latency.percentile(latency.getTouch(), 50) / 1000.0, 1) + String(F("ms median, ")) + String(latency.percentile(latency.getTouch(), 99) / 1000.0, 1) + String(F("ms p99, ")) + String(latency.getTouch().overSlo) + String(F(" of ")) + String(latency.getTouch().count) + String(F(" over ")) + String(LATENCY_TOUCH_SLO / 1000) + String(F("ms")));
+  _webSend(String(F("<br/><b>Debug Log Cost: </b>")) + String(debug.getLogAppendMaxMicros()) + String(F("us worst line, ")) + String(debug.getLogDrainMaxMicros()) + String(F("us worst drain, ")) + String(debug.getLogSyncMaxMicros()) + String(F("us worst inline line, ")) + String(debug.getLogDropped()) + String(F(" bytes dropped")));
+  if (debug.getSyslogServer()[0] != '\0')
+  {
+    _webSend(String(F("<br/><b>Syslog: </b>")) + String(debug.getSyslogServer()) + String(F(", ")) + String(debug.getSyslogSent()) + String(F(" datagrams sent, ")) + String(debug.getSyslogDropped()) + String(F(" bytes dropped")));
   }
-  httpMessage += String(F("<br/><b>MQTT ClientID: </b>")) + mqtt.getClientID();
-  httpMessage += String(F("<br/><b>HASP Version: </b>")) + String(config.getHaspVersion());
-  httpMessage += String(F("<br/><b>LCD Model: </b>")) + String(nextion.getModel());
-  httpMessage += String(F("<br/><b>LCD Version: </b>")) + String(nextion.getLCDVersion());
-  httpMessage += String(F("<br/><b>LCD Active Page: </b>")) + String(nextion.getActivePage());
-  httpMessage += String(F("<br/><b>CPU Frequency: </b>")) + String(ESP.getCpuFreqMHz()) + String(F("MHz"));
-  httpMessage += String(F("<br/><b>Sketch Size: </b>")) + String(ESP.getSketchSize()) + String(F(" bytes"));
-  httpMessage += String(F("<br/><b>Free Sketch Space: </b>")) + String(ESP.getFreeSketchSpace()) + String(F(" bytes"));
-  httpMessage += String(F("<br/><b>Heap Free: </b>")) + String(ESP.getFreeHeap());
-  httpMessage += String(F("<br/><b>Heap Fragmentation: </b>")) + String(ESP.getHeapFragmentation());
-  httpMessage += String(F("<br/><b>ESP core version: </b>")) + String(ESP.getCoreVersion());
-  httpMessage += String(F("<br/><b>IP Address: </b>")) + String(WiFi.localIP().toString());
-  httpMessage += String(F("<br/><b>Signal Strength: </b>")) + String(WiFi.RSSI());
-  httpMessage += String(F("<br/><b>Uptime: </b>")) + String(int32_t(millis() / 1000));
-  httpMessage += String(F("<br/><b>Last reset: </b>")) + String(ESP.getResetInfo());
+  _webSend(String(F("<br/><b>Quiet Debug Lines: </b>")) + String(debug.getLogSkipped(HMI)) + String(F(" HMI, ")) + String(debug.getLogSkipped(MQTT)) + String(F(" MQTT not built")));
+  _webSend(String(F("<br/><b>HTTP Heap Cost: </b>")) + String(_webLastCost) + String(F(" bytes last page, ")) + String(_webPeakCost) + String(F(" bytes peak")));
+  _webSend(String(F("<br/><b>Last reset: </b>")) + String(ESP.getResetInfo()));
 
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -417,11 +901,6 @@ void WebClass::_handleSaveConfig()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /saveConfig page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", String(config.getHaspNode()));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
 
   bool shouldSaveWifi = false;
   // Check required values
@@ -439,11 +918,13 @@ void WebClass::_handleSaveConfig()
   { // Handle mqttServer
     config.setSaveNeeded();
     webServer.arg("mqttServer").toCharArray(config.getMQTTServer(), 64);
+    config.setMQTTTlsMfln(MQTT_TLS_MFLN_UNKNOWN); // a different broker, probe it afresh
   }
   if (webServer.arg("mqttPort") != "" && webServer.arg("mqttPort") != String(config.getMQTTPort()))
   { // Handle mqttPort
     config.setSaveNeeded();
     webServer.arg("mqttPort").toCharArray(config.getMQTTPort(), 6);
+    config.setMQTTTlsMfln(MQTT_TLS_MFLN_UNKNOWN);
   }
   if (webServer.arg("haspNode") != "" && webServer.arg("haspNode") != String(config.getHaspNode()))
   { // Handle haspNode
@@ -468,6 +949,36 @@ void WebClass::_handleSaveConfig()
     config.setSaveNeeded();
     webServer.arg("mqttPassword").toCharArray(config.getMQTTPassword(), 32);
   }
+  if (webServer.arg("mqttBufferSize") != "" && webServer.arg("mqttBufferSize").toInt() != config.getMQTTBufferSize())
+  { // Handle mqttBufferSize
+    config.setSaveNeeded();
+    config.setMQTTBufferSize(webServer.arg("mqttBufferSize").toInt()); // clamped, 70000 or 10 would otherwise go straight in
+  }
+  if ((webServer.arg("mqttTls") == String("on")) && !config.getMQTTTls())
+  { // mqttTls was disabled but should now be enabled
+    config.setSaveNeeded();
+    config.setMQTTTls(true);
+  }
+  else if ((webServer.arg("mqttTls") == String("")) && config.getMQTTTls())
+  { // mqttTls was enabled but should now be disabled
+    config.setSaveNeeded();
+    config.setMQTTTls(false);
+  }
+  if (webServer.arg("mqttFingerprint") != String(config.getMQTTFingerprint()))
+  { // Handle mqttFingerprint
+    config.setSaveNeeded();
+    webServer.arg("mqttFingerprint").toCharArray(config.getMQTTFingerprint(), 60);
+  }
+  if ((webServer.arg("mqttTlsInsecure") == String("on")) && !config.getMQTTTlsInsecure())
+  { // mqttTlsInsecure was disabled but should now be enabled
+    config.setSaveNeeded();
+    config.setMQTTTlsInsecure(true);
+  }
+  else if ((webServer.arg("mqttTlsInsecure") == String("")) && config.getMQTTTlsInsecure())
+  { // mqttTlsInsecure was enabled but should now be disabled
+    config.setSaveNeeded();
+    config.setMQTTTlsInsecure(false);
+  }
   if (webServer.arg("configUser") != String(_configUser))
   { // Handle configUser
     config.setSaveNeeded();
@@ -503,6 +1014,11 @@ void WebClass::_handleSaveConfig()
     config.setSaveNeeded();
     debug.enableTelnet(false);
   }
+  if (webServer.arg("debugSyslogServer") != String(debug.getSyslogServer()))
+  { // Handle debugSyslogServer
+    config.setSaveNeeded();
+    debug.setSyslogServer(webServer.arg("debugSyslogServer").c_str());
+  }
   if ((webServer.arg("mdnsEnabled") == String("on")) && !config.getMDNSEnabled())
   { // mdnsEnabled was disabled but should now be enabled
     config.setSaveNeeded();
@@ -513,6 +1029,26 @@ void WebClass::_handleSaveConfig()
     config.setSaveNeeded();
     config.setMDSNEnabled(false);
   }
+  if ((webServer.arg("mqttPersistent") == String("on")) && !config.getMQTTPersistent())
+  { // mqttPersistent was disabled but should now be enabled
+    config.setSaveNeeded();
+    config.setMQTTPersistent(true);
+  }
+  else if ((webServer.arg("mqttPersistent") == String("")) && config.getMQTTPersistent())
+  { // mqttPersistent was enabled but should now be disabled
+    config.setSaveNeeded();
+    config.setMQTTPersistent(false);
+  }
+  if ((webServer.arg("mqttSnapshot") == String("on")) && !config.getMQTTSnapshot())
+  { // mqttSnapshot was disabled but should now be enabled
+    config.setSaveNeeded();
+    config.setMQTTSnapshot(true);
+  }
+  else if ((webServer.arg("mqttSnapshot") == String("")) && config.getMQTTSnapshot())
+  { // mqttSnapshot was enabled but should now be disabled
+    config.setSaveNeeded();
+    config.setMQTTSnapshot(false);
+  }
   if ((webServer.arg("beepEnabled") == String("on")) && !beep.getEnable())
   { // beepEnabled was disabled but should now be enabled
     config.setSaveNeeded();
@@ -526,12 +1062,12 @@ void WebClass::_handleSaveConfig()
 
   if (config.getSaveNeeded())
   { // Config updated, notify user and trigger write to SPIFFS
-    httpMessage += String(F("<meta http-equiv='refresh' content='15;url=/' />"));
-    httpMessage += FPSTR(HTTP_HEADER_END);
-    httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>"));
-    httpMessage += String(F("<br/>Saving updated configuration values and restarting device"));
-    httpMessage += FPSTR(HTTP_END);
-    webServer.send(200, "text/html", httpMessage);
+    _webStart(String(config.getHaspNode()));
+    _webSend(F("<meta http-equiv='refresh' content='15;url=/' />"));
+    _webSend_P(HTTP_HEADER_END);
+    _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>")));
+    _webSend(F("<br/>Saving updated configuration values and restarting device"));
+    _webEnd();
 
     config.saveFile();
     if (shouldSaveWifi)
@@ -543,12 +1079,12 @@ void WebClass::_handleSaveConfig()
   }
   else
   { // No change found, notify user and link back to config page
-    httpMessage += String(F("<meta http-equiv='refresh' content='3;url=/' />"));
-    httpMessage += FPSTR(HTTP_HEADER_END);
-    httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>"));
-    httpMessage += String(F("<br/>No changes found, returning to <a href='/'>home page</a>"));
-    httpMessage += FPSTR(HTTP_END);
-    webServer.send(200, "text/html", httpMessage);
+    _webStart(String(config.getHaspNode()));
+    _webSend(F("<meta http-equiv='refresh' content='3;url=/' />"));
+    _webSend_P(HTTP_HEADER_END);
+    _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>")));
+    _webSend(F("<br/>No changes found, returning to <a href='/'>home page</a>"));
+    _webEnd();
   }
 }
 
@@ -558,32 +1094,26 @@ void WebClass::_handleResetConfig()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /resetConfig page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", String(config.getHaspNode()));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += FPSTR(HTTP_HEADER_END);
+  _webStart(String(config.getHaspNode()));
+  _webSend_P(HTTP_HEADER_END);
 
   if (webServer.arg("confirm") == "yes")
   { // User has confirmed, so reset everything
-    httpMessage += String(F("<h1>"));
-    httpMessage += String(config.getHaspNode());
-    httpMessage += String(F("</h1><b>Resetting all saved settings and restarting device into WiFi AP mode</b>"));
-    httpMessage += FPSTR(HTTP_END);
-    webServer.send(200, "text/html", httpMessage);
+    _webSend(F("<h1>"));
+    _webSend(String(config.getHaspNode()));
+    _webSend(F("</h1><b>Resetting all saved settings and restarting device into WiFi AP mode</b>"));
+    _webEnd();
     delay(1000);
     config.clearFileSystem();
   }
   else
   {
-    httpMessage += String(F("<h1>Warning</h1><b>This process will reset all settings to the default values and restart the device.  You may need to connect to the WiFi AP displayed on the panel to re-configure the device before accessing it again."));
-    httpMessage += String(F("<br/><hr><br/><form method='get' action='resetConfig'>"));
-    httpMessage += String(F("<br/><br/><button type='submit' name='confirm' value='yes'>reset all settings</button></form>"));
-    httpMessage += String(F("<br/><hr><br/><form method='get' action='/'>"));
-    httpMessage += String(F("<button type='submit'>return home</button></form>"));
-    httpMessage += FPSTR(HTTP_END);
-    webServer.send(200, "text/html", httpMessage);
+    _webSend(F("<h1>Warning</h1><b>This process will reset all settings to the default values and restart the device.  You may need to connect to the WiFi AP displayed on the panel to re-configure the device before accessing it again."));
+    _webSend(F("<br/><hr><br/><form method='get' action='resetConfig'>"));
+    _webSend(F("<br/><br/><button type='submit' name='confirm' value='yes'>reset all settings</button></form>"));
+    _webSend(F("<br/><hr><br/><form method='get' action='/'>"));
+    _webSend(F("<button type='submit'>return home</button></form>"));
+    _webEnd();
   }
 }
 
@@ -593,17 +1123,12 @@ void WebClass::_handleResetBacklight()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /resetBacklight page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " HASP backlight reset"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += String(F("<meta http-equiv='refresh' content='3;url=/' />"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>"));
-  httpMessage += String(F("<br/>Resetting backlight to 100%"));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " HASP backlight reset");
+  _webSend(F("<meta http-equiv='refresh' content='3;url=/' />"));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>")));
+  _webSend(F("<br/>Resetting backlight to 100%"));
+  _webEnd();
   debug.printLn(F("HTTP: Resetting backlight to 100%"));
   nextion.setAttr("dims", "100");
 }
@@ -614,61 +1139,46 @@ void WebClass::_handleFirmware()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /firmware page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " update"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F(" firmware</h1>"));
+  _webStart(String(config.getHaspNode()) + " update");
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F(" firmware</h1>")));
 
   // Display main firmware page
   // HTTPS Disabled pending resolution of issue: https://github.com/esp8266/Arduino/issues/4696
   // Until then, using a proxy host at http://haswitchplate.com to deliver unsecured firmware images from GitHub
-  httpMessage += String(F("<form method='get' action='/espfirmware'>"));
+  _webSend(F("<form method='get' action='/espfirmware'>"));
   if (config.isEspUpdateAvailable())
   {
-    httpMessage += String(F("<font color='green'><b>HASP ESP8266 update available!</b></font>"));
+    _webSend(F("<font color='green'><b>HASP ESP8266 update available!</b></font>"));
   }
-  httpMessage += String(F("<br/><b>Update ESP8266 from URL</b><small><i> http only</i></small>"));
-  httpMessage += String(F("<br/><input id='espFirmwareURL' name='espFirmware' value='")) + config.getEspFirmwareUrl() + "'>";
-  httpMessage += String(F("<br/><br/><button type='submit'>Update ESP from URL</button></form>"));
+  _webSend(F("<br/><b>Update ESP8266 from URL</b><small><i> http only</i></small>"));
+  _webSend(String(F("<br/><input id='espFirmwareURL' name='espFirmware' value='")) + config.getEspFirmwareUrl() + "'>");
+  _webSend(F("<br/><br/><button type='submit'>Update ESP from URL</button></form>"));
 
-  httpMessage += String(F("<br/><form method='POST' action='/update' enctype='multipart/form-data'>"));
-  httpMessage += String(F("<b>Update ESP8266 from file</b><input type='file' id='espSelect' name='espSelect' accept='.bin'>"));
-  httpMessage += String(F("<br/><br/><button type='submit' id='espUploadSubmit' onclick='ackEspUploadSubmit()'>Update ESP from file</button></form>"));
+  _webSend(F("<br/><form method='POST' action='/update' enctype='multipart/form-data'>"));
+  _webSend(F("<b>Update ESP8266 from file</b><input type='file' id='espSelect' name='espSelect' accept='.bin'>"));
+  _webSend(F("<br/><br/><button type='submit' id='espUploadSubmit' onclick='ackEspUploadSubmit()'>Update ESP from file</button></form>"));
 
-  httpMessage += String(F("<br/><br/><hr><h1>WARNING!</h1>"));
-  httpMessage += String(F("<b>Nextion LCD firmware updates can be risky.</b> If interrupted, the HASP will need to be manually power cycled which might mean a trip to the breaker box. "));
-  httpMessage += String(F("After a power cycle, the LCD will display an error message until a successful firmware update has completed.<br/>"));
+  _webSend(F("<br/><br/><hr><h1>WARNING!</h1>"));
+  _webSend(F("<b>Nextion LCD firmware updates can be risky.</b> If interrupted, the HASP will need to be manually power cycled which might mean a trip to the breaker box. "));
+  _webSend(F("After a power cycle, the LCD will display an error message until a successful firmware update has completed.<br/>"));
 
-  httpMessage += String(F("<br/><hr><form method='get' action='lcddownload'>"));
+  _webSend(F("<br/><hr><form method='get' action='lcddownload'>"));
   if (config.isLcdUpdateAvailable())
   {
-    httpMessage += String(F("<font color='green'><b>HASP LCD update available!</b></font>"));
+    _webSend(F("<font color='green'><b>HASP LCD update available!</b></font>"));
   }
-  httpMessage += String(F("<br/><b>Update Nextion LCD from URL</b><small><i> http only</i></small>"));
-  httpMessage += String(F("<br/><input id='lcdFirmware' name='lcdFirmware' value='")) + config.getLcdFirmwareUrl() + "'>";
-  httpMessage += String(F("<br/><br/><button type='submit'>Update LCD from URL</button></form>"));
+  _webSend(F("<br/><b>Update Nextion LCD from URL</b><small><i> http only</i></small>"));
+  _webSend(String(F("<br/><input id='lcdFirmware' name='lcdFirmware' value='")) + config.getLcdFirmwareUrl() + "'>");
+  _webSend(F("<br/><br/><button type='submit'>Update LCD from URL</button></form>"));
 
-  httpMessage += String(F("<br/><form method='POST' action='/lcdupload' enctype='multipart/form-data'>"));
-  httpMessage += String(F("<br/><b>Update Nextion LCD from file</b><input type='file' id='lcdSelect' name='files[]' accept='.tft'/>"));
-  httpMessage += String(F("<br/><br/><button type='submit' id='lcdUploadSubmit' onclick='ackLcdUploadSubmit()'>Update LCD from file</button></form>"));
+  _webSend(F("<br/><form method='POST' action='/lcdupload' enctype='multipart/form-data'>"));
+  _webSend(F("<br/><b>Update Nextion LCD from file</b><input type='file' id='lcdSelect' name='files[]' accept='.tft'/>"));
+  _webSend(F("<br/><br/><button type='submit' id='lcdUploadSubmit' onclick='ackLcdUploadSubmit()'>Update LCD from file</button></form>"));
 
-  // Javascript to collect the filesize of the LCD upload and send it to /tftFileSize
-  httpMessage += String(F("<script>function handleLcdFileSelect(evt) {"));
-  httpMessage += String(F("var uploadFile = evt.target.files[0];"));
-  httpMessage += String(F("document.getElementById('lcdUploadSubmit').innerHTML = 'Upload LCD firmware ' + uploadFile.name;"));
-  httpMessage += String(F("var tftFileSize = '/tftFileSize?tftFileSize=' + uploadFile.size;"));
-  httpMessage += String(F("var xhttp = new XMLHttpRequest();xhttp.open('GET', tftFileSize, true);xhttp.send();}"));
-  httpMessage += String(F("function ackLcdUploadSubmit() {document.getElementById('lcdUploadSubmit').innerHTML = 'Uploading LCD firmware...';}"));
-  httpMessage += String(F("function handleEspFileSelect(evt) {var uploadFile = evt.target.files[0];document.getElementById('espUploadSubmit').innerHTML = 'Upload ESP firmware ' + uploadFile.name;}"));
-  httpMessage += String(F("function ackEspUploadSubmit() {document.getElementById('espUploadSubmit').innerHTML = 'Uploading ESP firmware...';}"));
-  httpMessage += String(F("document.getElementById('lcdSelect').addEventListener('change', handleLcdFileSelect, false);"));
-  httpMessage += String(F("document.getElementById('espSelect').addEventListener('change', handleEspFileSelect, false);</script>"));
+  // Javascript to collect the filesize of the LCD upload and send it to /tftFileSize lives in /hasp.js
 
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -677,19 +1187,14 @@ void WebClass::_handleEspFirmware()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /espfirmware page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " ESP update"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += String(F("<meta http-equiv='refresh' content='60;url=/' />"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>"));
-  httpMessage += String(config.getHaspNode()) + " ESP update";
-  httpMessage += String(F("</h1>"));
-  httpMessage += "<br/>Updating ESP firmware from: " + String(webServer.arg("espFirmware"));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " ESP update");
+  _webSend(F("<meta http-equiv='refresh' content='60;url=/' />"));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(F("<h1>"));
+  _webSend(String(config.getHaspNode()) + " ESP update");
+  _webSend(F("</h1>"));
+  _webSend("<br/>Updating ESP firmware from: " + String(webServer.arg("espFirmware")));
+  _webEnd();
 
   debug.printLn("ESPFW: Attempting ESP firmware update from: " + String(webServer.arg("espFirmware")));
   esp.startOta(webServer.arg("espFirmware"));
@@ -703,8 +1208,6 @@ void WebClass::_handleLcdUpload()
   if( !_authenticated() ) { return; }
 
   static uint32_t lcdOtaTransferred = 0;
-  static uint32_t lcdOtaRemaining;
-  static uint16_t lcdOtaParts;
   const uint32_t lcdOtaTimeout = 30000; // timeout for receiving new data in milliseconds
   static uint32_t lcdOtaTimer = 0;      // timer for upload timeout
 
@@ -713,17 +1216,12 @@ void WebClass::_handleLcdUpload()
   if (_tftFileSize == 0)
   {
     debug.printLn(String(F("LCD OTA: FAILED, no filesize sent.")));
-    String httpMessage = FPSTR(HTTP_HEADER);
-    httpMessage.replace("{v}", (String(config.getHaspNode()) + " LCD update"));
-    httpMessage += FPSTR(HTTP_SCRIPT);
-    httpMessage += FPSTR(HTTP_STYLE);
-    httpMessage += String(_haspStyle);
-    httpMessage += String(F("<meta http-equiv='refresh' content='5;url=/' />"));
-    httpMessage += FPSTR(HTTP_HEADER_END);
-    httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + " LCD update FAILED</h1>";
-    httpMessage += String(F("No update file size reported.  You must use a modern browser with Javascript enabled."));
-    httpMessage += FPSTR(HTTP_END);
-    webServer.send(200, "text/html", httpMessage);
+    _webStart(String(config.getHaspNode()) + " LCD update");
+    _webSend(F("<meta http-equiv='refresh' content='5;url=/' />"));
+    _webSend_P(HTTP_HEADER_END);
+    _webSend(String(F("<h1>")) + String(config.getHaspNode()) + " LCD update FAILED</h1>");
+    _webSend(F("No update file size reported.  You must use a modern browser with Javascript enabled."));
+    _webEnd();
   }
   else if ((lcdOtaTimer > 0) && ((millis() - lcdOtaTimer) > lcdOtaTimeout))
   { // Our timer expired so reset
@@ -738,21 +1236,10 @@ void WebClass::_handleLcdUpload()
     debug.printLn(String(F("LCD OTA: upload.filename: ")) + String(upload.filename));
     debug.printLn(String(F("LCD OTA: TFTfileSize: ")) + String(_tftFileSize));
 
-    lcdOtaRemaining = _tftFileSize;
-    lcdOtaParts = (lcdOtaRemaining / 4096) + 1;
-    debug.printLn(String(F("LCD OTA: File upload beginning. Size ")) + String(lcdOtaRemaining) + String(F(" bytes in ")) + String(lcdOtaParts) + String(F(" 4k chunks.")));
-
-    Serial1.write(nextion.Suffix, sizeof(nextion.Suffix)); // Send empty command to LCD
-    Serial1.flush();
-    nextion.handleInput();
+    uint16_t lcdOtaParts = (_tftFileSize / 4096) + 1;
+    debug.printLn(String(F("LCD OTA: File upload beginning. Size ")) + String(_tftFileSize) + String(F(" bytes in ")) + String(lcdOtaParts) + String(F(" 4k chunks.")));
 
-    String lcdOtaNextionCmd = "whmi-wri " + String(_tftFileSize) + ",115200,0";
-    debug.printLn(String(F("LCD OTA: Sending LCD upload command: ")) + lcdOtaNextionCmd);
-    Serial1.print(lcdOtaNextionCmd);
-    Serial1.write(nextion.Suffix, sizeof(nextion.Suffix));
-    Serial1.flush();
-
-    if (nextion.otaResponse())
+    if (nextion.otaBegin(_tftFileSize))
     {
       debug.printLn(F("LCD OTA: LCD upload command accepted"));
     }
@@ -765,72 +1252,25 @@ void WebClass::_handleLcdUpload()
   }
   else if (upload.status == UPLOAD_FILE_WRITE)
   { // Handle upload data
-    static int lcdOtaChunkCounter = 0;
-    static uint16_t lcdOtaPartNum = 0;
-    static int lcdOtaPercentComplete = 0;
-    static const uint16_t lcdOtaBufferSize = 1024; // upload data buffer before sending to UART
-    static uint8_t lcdOtaBuffer[lcdOtaBufferSize] = {};
-    uint16_t lcdOtaUploadIndex = 0;
-    int32_t lcdOtaPacketRemaining = upload.currentSize;
-
-    while (lcdOtaPacketRemaining > 0)
-    { // Write incoming data to panel as it arrives
-      // determine chunk size as lowest value of lcdOtaPacketRemaining, lcdOtaBufferSize, or 4096 - lcdOtaChunkCounter
-      uint16_t lcdOtaChunkSize = 0;
-      if ((lcdOtaPacketRemaining <= lcdOtaBufferSize) && (lcdOtaPacketRemaining <= (4096 - lcdOtaChunkCounter)))
-      {
-        lcdOtaChunkSize = lcdOtaPacketRemaining;
-      }
-      else if ((lcdOtaBufferSize <= lcdOtaPacketRemaining) && (lcdOtaBufferSize <= (4096 - lcdOtaChunkCounter)))
-      {
-        lcdOtaChunkSize = lcdOtaBufferSize;
-      }
-      else
-      {
-        lcdOtaChunkSize = 4096 - lcdOtaChunkCounter;
-      }
-
-      for (uint16_t i = 0; i < lcdOtaChunkSize; i++)
-      { // Load up the UART buffer
-        lcdOtaBuffer[i] = upload.buf[lcdOtaUploadIndex];
-        lcdOtaUploadIndex++;
-      }
-      Serial1.flush();                              // Clear out current UART buffer
-      Serial1.write(lcdOtaBuffer, lcdOtaChunkSize); // And send the most recent data
-      lcdOtaChunkCounter += lcdOtaChunkSize;
-      lcdOtaTransferred += lcdOtaChunkSize;
-      if (lcdOtaChunkCounter >= 4096)
-      {
-        Serial1.flush();
-        lcdOtaPartNum++;
-        lcdOtaPercentComplete = (lcdOtaTransferred * 100) / _tftFileSize;
-        lcdOtaChunkCounter = 0;
-        if (nextion.otaResponse())
-        {
-          debug.printLn(String(F("LCD OTA: Part ")) + String(lcdOtaPartNum) + String(F(" OK, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
-        }
-        else
-        {
-          debug.printLn(String(F("LCD OTA: Part ")) + String(lcdOtaPartNum) + String(F(" FAILED, ")) + String(lcdOtaPercentComplete) + String(F("% complete")));
-        }
-      }
-      else
-      {
-        delay(10);
-      }
-      if (lcdOtaRemaining > 0)
-      {
-        lcdOtaRemaining -= lcdOtaChunkSize;
-      }
-      if (lcdOtaPacketRemaining > 0)
-      {
-        lcdOtaPacketRemaining -= lcdOtaChunkSize;
+    if (!nextion.otaWrite(upload.buf, upload.currentSize))
+    { // the panel missed an ACK, there is no recovering from that mid-file, the browser won't send it again
+      nextion.otaAbort();
+      debug.printLn(F("LCD OTA: Failure"));
+      webServer.sendHeader("Location", "/lcdOtaFailure");
+      webServer.send(303);
+      uint32_t lcdOtaDelay = millis();
+      while ((millis() - lcdOtaDelay) < 1000)
+      { // extra 1sec delay for client to grab failure page
+        webServer.handleClient();
+        delay(1);
       }
+      esp.reset();
     }
+    lcdOtaTransferred = nextion.getOtaAccepted();
 
     if (lcdOtaTransferred >= _tftFileSize)
     {
-      if (nextion.otaResponse())
+      if (nextion.otaEnd())
       {
         debug.printLn(String(F("LCD OTA: Success, wrote ")) + String(lcdOtaTransferred) + " of " + String(_tftFileSize) + " bytes.");
         webServer.sendHeader("Location", "/lcdOtaSuccess");
@@ -863,7 +1303,7 @@ void WebClass::_handleLcdUpload()
   { // Upload completed
     if (lcdOtaTransferred >= _tftFileSize)
     {
-      if (nextion.otaResponse())
+      if (nextion.otaEnd())
       { // YAY WE DID IT
         debug.printLn(String(F("LCD OTA: Success, wrote ")) + String(lcdOtaTransferred) + " of " + String(_tftFileSize) + " bytes.");
         webServer.sendHeader("Location", "/lcdOtaSuccess");
@@ -927,17 +1367,12 @@ void WebClass::_handleLcdUpdateSuccess()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /lcdOtaSuccess page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " LCD update success"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += String(F("<meta http-equiv='refresh' content='15;url=/' />"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F(" LCD update success</h1>"));
-  httpMessage += String(F("Restarting HASwitchPlate to apply changes..."));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " LCD update success");
+  _webSend(F("<meta http-equiv='refresh' content='15;url=/' />"));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F(" LCD update success</h1>")));
+  _webSend(F("Restarting HASwitchPlate to apply changes..."));
+  _webEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -946,17 +1381,12 @@ void WebClass::_handleLcdUpdateFailure()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /lcdOtaFailure page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " LCD update failed"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += String(F("<meta http-equiv='refresh' content='15;url=/' />"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F(" LCD update failed :(</h1>"));
-  httpMessage += String(F("Restarting HASwitchPlate to reset device..."));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " LCD update failed");
+  _webSend(F("<meta http-equiv='refresh' content='15;url=/' />"));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F(" LCD update failed :(</h1>")));
+  _webSend(F("Restarting HASwitchPlate to reset device..."));
+  _webEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -965,18 +1395,13 @@ void WebClass::_handleLcdDownload()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /lcddownload page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " LCD update"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>"));
-  httpMessage += String(config.getHaspNode()) + " LCD update";
-  httpMessage += String(F("</h1>"));
-  httpMessage += "<br/>Updating LCD firmware from: " + String(webServer.arg("lcdFirmware"));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " LCD update");
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(F("<h1>"));
+  _webSend(String(config.getHaspNode()) + " LCD update");
+  _webSend(F("</h1>"));
+  _webSend("<br/>Updating LCD firmware from: " + String(webServer.arg("lcdFirmware")));
+  _webEnd();
 
   nextion.startOtaDownload(webServer.arg("lcdFirmware"));
 }
@@ -987,11 +1412,9 @@ void WebClass::_handleTftFileSize()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /tftFileSize page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " TFT Filesize"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " TFT Filesize", false);
+  _webSend_P(HTTP_HEADER_END);
+  _webEnd();
   _tftFileSize = webServer.arg("tftFileSize").toInt();
   debug.printLn(String(F("WEB: tftFileSize: ")) + String(_tftFileSize));
 }
@@ -1002,17 +1425,12 @@ void WebClass::_handleReboot()
   if( !_authenticated() ) { return; }
 
   debug.printLn(String(F("HTTP: Sending /reboot page to client connected from: ")) + webServer.client().remoteIP().toString());
-  String httpMessage = FPSTR(HTTP_HEADER);
-  httpMessage.replace("{v}", (String(config.getHaspNode()) + " HASP reboot"));
-  httpMessage += FPSTR(HTTP_SCRIPT);
-  httpMessage += FPSTR(HTTP_STYLE);
-  httpMessage += String(_haspStyle);
-  httpMessage += String(F("<meta http-equiv='refresh' content='10;url=/' />"));
-  httpMessage += FPSTR(HTTP_HEADER_END);
-  httpMessage += String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>"));
-  httpMessage += String(F("<br/>Rebooting device"));
-  httpMessage += FPSTR(HTTP_END);
-  webServer.send(200, "text/html", httpMessage);
+  _webStart(String(config.getHaspNode()) + " HASP reboot");
+  _webSend(F("<meta http-equiv='refresh' content='10;url=/' />"));
+  _webSend_P(HTTP_HEADER_END);
+  _webSend(String(F("<h1>")) + String(config.getHaspNode()) + String(F("</h1>")));
+  _webSend(F("<br/>Rebooting device"));
+  _webEnd();
   debug.printLn(F("RESET: Rebooting device"));
   nextion.sendCmd("page 0");
   nextion.setAttr("p[0].b[1].txt", "\"Rebooting...\"");
@@ -16,16 +16,17 @@
 #include "settings.h"
 #include <Arduino.h>
 
-// Additional CSS style to match Hass theme
+// Additional CSS style to match Hass theme, used by the WiFiManager portal
+// our own pages get the same rules from web_static/hasp.css
 // too long to fit inside class Protected area?
 static const char _haspStyle[] = "<style>button{background-color:#03A9F4;}body{width:60%;margin:auto;}input:invalid{border:1px solid red;}input[type=checkbox]{width:20px;}</style>";
 
-class WebClass {
+class WebClass : public Print {
 private:
 public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   // constructor
-  WebClass(void) { _alive = false; }
+  WebClass(void) { _alive = false; _webLastCost = 0; _webPeakCost = 0; _webLoopMaxMicros = 0; _mdnsUpdateTimer = 0; }
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   // destructor
@@ -48,6 +49,35 @@ public:
   char *getPassword(void) { return _configPassword; }
   void setPassword(const char *value) { strncpy(_configPassword, value, 32); _configPassword[31]='\0'; }
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Print interface, writes into the current chunked response
+  size_t write(uint8_t character);
+  size_t write(const uint8_t *buffer, size_t size);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleEvents();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiStatus();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiCmd();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiCache();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiTrace();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiProfile();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleApiLatency();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handleStatic(const uint8_t *content, size_t contentLength, PGM_P contentType, const char *etag);
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _handleNotFound();
 
@@ -90,21 +120,63 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   uint32_t getTftFileSize() { return this->_tftFileSize; }
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getWebPeakCost() { return _webPeakCost; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline uint32_t getWebLoopMaxMicros() { return _webLoopMaxMicros; }
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void telnetPrintLn(bool enabled, String message);
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void telnetPrint(bool enabled, String message);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // non-blocking telnet output for the debug log ring
+  bool telnetConnected(bool enabled);
+  size_t telnetAvailableForWrite(bool enabled);
+  void telnetWrite(const uint8_t *buffer, size_t size);
+
 protected:
   bool _alive;
   char _configUser[32]; // these two might belong in WebClass
   char _configPassword[32]; // these two might belong in WebClass
   uint32_t _tftFileSize;
+  String   _webChunk;      // pending dynamic content for the current chunked response
+  uint32_t _webHeapStart;  // free heap when the current response started
+  uint32_t _webHeapLow;    // lowest free heap seen while sending the current response
+  uint32_t _webLastCost;   // heap cost in bytes of the last page sent
+  uint32_t _webPeakCost;   // worst heap cost in bytes of any page since boot
+  uint32_t _webLoopMaxMicros; // worst time in usec spent in one pass of webServer.handleClient()
+  uint32_t _mdnsUpdateTimer;  // millis() at the last MDNS.update()
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   bool _authenticated(void);
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webBegin(int code, const char *contentType);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webStart(const String &title, bool styled = true);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webSend(const String &fragment);
+  void _webSend(const __FlashStringHelper *fragment);
+  void _webSend(const char *fragment);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webSend_P(PGM_P fragment);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webFlush();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webEnd();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _webFinish();
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   void _setupHTTP();
 
@@ -0,0 +1,86 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// web_static.h : gzipped admin page CSS/JS, GENERATED by pio_script/gzip-static.py
+// edit the files in web_static/ and rebuild, do not edit this file
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+// This file is only #included once, mmkay
+#pragma once
+
+#include <Arduino.h>
+
+// hasp.css: 425 bytes, 273 bytes gzipped
+#define WEB_STATIC_CSS_ETAG ("\"b8f21c52ee416ebf\"")
+static const uint8_t WEB_STATIC_CSS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x90, 0xcd, 0x6e, 0x83, 0x30,
+  0x10, 0x84, 0xef, 0x79, 0x8a, 0x48, 0x55, 0x6f, 0x05, 0xf1, 0x97, 0x4a, 0x59, 0x94, 0x43, 0x2f,
+  0x7d, 0x89, 0xaa, 0x07, 0x63, 0xaf, 0x61, 0x15, 0xb0, 0xa9, 0x59, 0x28, 0x14, 0xe5, 0xdd, 0x6b,
+  0x0a, 0xa8, 0x91, 0xda, 0x9b, 0xbd, 0x3b, 0x33, 0xfe, 0xc6, 0xa1, 0x9c, 0x19, 0x47, 0x0e, 0x44,
+  0x4d, 0xa5, 0x01, 0x89, 0x86, 0xd1, 0xe5, 0xb7, 0x83, 0xa2, 0xe1, 0x89, 0x4c, 0xdb, 0xf3, 0xdc,
+  0x0a, 0xa5, 0xc8, 0x94, 0x70, 0x6a, 0xc7, 0x5c, 0x5b, 0xc3, 0x41, 0x47, 0x5f, 0x08, 0x31, 0x36,
+  0x5e, 0xb5, 0x2a, 0x3e, 0x49, 0x71, 0x05, 0xe7, 0xd3, 0xa3, 0x9f, 0x14, 0x56, 0x4d, 0xff, 0x04,
+  0xfe, 0x18, 0xb5, 0x68, 0xa8, 0x9e, 0x60, 0x40, 0xa7, 0x84, 0x11, 0x8b, 0xb8, 0x67, 0xb6, 0x66,
+  0x2e, 0xac, 0x53, 0xe8, 0x20, 0xca, 0xd7, 0x43, 0xe0, 0x84, 0xa2, 0xbe, 0x83, 0x28, 0x4c, 0x9d,
+  0x7f, 0xa5, 0x10, 0xf2, 0x5a, 0x3a, 0xdb, 0x1b, 0x15, 0x48, 0x5b, 0x5b, 0x07, 0x0f, 0xb1, 0x16,
+  0x29, 0xca, 0x7c, 0xbb, 0x69, 0xad, 0xf3, 0x9a, 0x0c, 0x06, 0x15, 0x52, 0x59, 0x31, 0x24, 0x61,
+  0xb6, 0xd8, 0xee, 0x50, 0xc3, 0x64, 0x19, 0xac, 0x94, 0x71, 0x14, 0x2d, 0x98, 0xe1, 0xc7, 0xac,
+  0x6b, 0x2b, 0x18, 0xdc, 0xe2, 0xd9, 0x76, 0xcf, 0x99, 0xaf, 0x78, 0xc7, 0xbe, 0xee, 0x7e, 0x31,
+  0xff, 0x80, 0x44, 0xe9, 0xcb, 0xf9, 0x35, 0xdb, 0x5b, 0x6f, 0x21, 0x3e, 0xbf, 0x11, 0xae, 0x24,
+  0x03, 0xa2, 0x67, 0xbb, 0x7f, 0x12, 0x90, 0x19, 0x7c, 0xaa, 0xda, 0xcb, 0xc6, 0xed, 0x78, 0xec,
+  0xac, 0x1f, 0x1c, 0x1d, 0xaa, 0x5d, 0xf4, 0xc6, 0x53, 0x8b, 0x17, 0x59, 0xa1, 0xbc, 0x16, 0x76,
+  0x7c, 0xdf, 0x12, 0x93, 0xc8, 0x63, 0xdd, 0x0e, 0xdf, 0x30, 0xb4, 0xa7, 0x9d, 0xa9, 0x01, 0x00,
+  0x00,
+};
+
+// hasp.js: 2029 bytes, 726 bytes gzipped
+#define WEB_STATIC_JS_ETAG ("\"68766349a2e2a383\"")
+static const uint8_t WEB_STATIC_JS[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xa5, 0x54, 0x4d, 0x6f, 0x13, 0x31,
+  0x10, 0xbd, 0xf7, 0x57, 0x98, 0x93, 0x37, 0x6a, 0xe3, 0x16, 0x24, 0x2e, 0x8d, 0x42, 0x05, 0x6d,
+  0xa0, 0xa0, 0x94, 0x22, 0x52, 0x04, 0x52, 0xe9, 0x61, 0xb3, 0x9e, 0x6c, 0xac, 0x3a, 0xf6, 0xb2,
+  0xf6, 0x36, 0x2d, 0x28, 0xff, 0x9d, 0x19, 0x3b, 0xd9, 0xec, 0x92, 0x90, 0x56, 0x6a, 0x0e, 0x51,
+  0x3c, 0x1f, 0x6f, 0xde, 0xbc, 0x99, 0xc9, 0xa4, 0x32, 0x99, 0x57, 0xd6, 0xb0, 0x69, 0x6a, 0xa4,
+  0x86, 0x61, 0x26, 0xdf, 0x2b, 0x0d, 0x23, 0xd0, 0x90, 0xf9, 0x04, 0xee, 0x7c, 0x87, 0xfd, 0xd9,
+  0x63, 0xec, 0x2e, 0x2d, 0x59, 0x55, 0x68, 0x9b, 0x06, 0x2f, 0xeb, 0x33, 0xf4, 0x08, 0x9f, 0x96,
+  0x39, 0x78, 0x31, 0x41, 0x8b, 0xbb, 0x3e, 0xba, 0xe9, 0x61, 0x9c, 0xb4, 0x59, 0x35, 0x03, 0xe3,
+  0x05, 0x3a, 0x06, 0x1a, 0xe8, 0xe7, 0xbb, 0x87, 0x8f, 0x32, 0xe1, 0x3a, 0x93, 0xdf, 0x42, 0xfe,
+  0xa8, 0x1a, 0xcf, 0x94, 0xe7, 0x1d, 0xa1, 0x8c, 0x81, 0xf2, 0xfc, 0xea, 0x62, 0x88, 0x68, 0x3c,
+  0xfa, 0xd8, 0xf0, 0xf4, 0x8c, 0x4d, 0x54, 0x39, 0x9b, 0xa7, 0x25, 0x30, 0xce, 0xf6, 0x1b, 0x35,
+  0x85, 0x49, 0x67, 0xd0, 0x5b, 0x52, 0xf1, 0x13, 0x1f, 0x58, 0xaa, 0xdf, 0xc4, 0x85, 0x1f, 0x36,
+  0xde, 0x27, 0x8d, 0xdf, 0xfd, 0x7f, 0x20, 0x1c, 0xda, 0x56, 0x10, 0xf7, 0x53, 0xef, 0x0b, 0x4c,
+  0x36, 0x30, 0x67, 0x3f, 0x2e, 0x86, 0xe7, 0xf8, 0xfa, 0x0a, 0xbf, 0x2a, 0x70, 0x3e, 0xe9, 0xf4,
+  0xa2, 0x57, 0xd8, 0x02, 0x4c, 0xc2, 0x3f, 0x0c, 0xae, 0xf8, 0x41, 0xb3, 0x24, 0x3e, 0xca, 0x0a,
+  0xea, 0x28, 0x07, 0x46, 0x62, 0xce, 0xde, 0x62, 0x6f, 0xb2, 0xd2, 0x32, 0xcd, 0x6e, 0x87, 0xed,
+  0x86, 0x13, 0xd4, 0xf1, 0x99, 0xea, 0x28, 0x93, 0xb7, 0x04, 0x12, 0x42, 0xf0, 0x1e, 0x6b, 0x54,
+  0x8d, 0x13, 0x1c, 0xb8, 0x62, 0x63, 0x82, 0x4f, 0x9b, 0xdf, 0xff, 0xf9, 0x81, 0x2b, 0x9e, 0x30,
+  0xbd, 0xc1, 0xe8, 0xcb, 0xee, 0xe9, 0xb1, 0xb6, 0x44, 0x83, 0x36, 0xea, 0x6e, 0x89, 0x9e, 0x44,
+  0x81, 0x24, 0x6a, 0xb2, 0x58, 0x49, 0x34, 0x57, 0x46, 0xda, 0xb9, 0x48, 0xa5, 0x1c, 0xdc, 0x21,
+  0xe2, 0x50, 0x39, 0x0f, 0x98, 0x9c, 0xf0, 0xb3, 0xcb, 0x8b, 0x53, 0x6b, 0x3c, 0xd9, 0x30, 0x1d,
+  0x24, 0x0e, 0xba, 0x66, 0x98, 0xac, 0x57, 0x1f, 0xe7, 0x13, 0xf5, 0xc4, 0x52, 0xbb, 0x86, 0x18,
+  0x83, 0x78, 0x67, 0xb5, 0x64, 0x48, 0xfa, 0xf1, 0xbc, 0x3a, 0x28, 0xe6, 0xa9, 0x09, 0x4b, 0x6a,
+  0x28, 0x92, 0xa4, 0x7e, 0x6c, 0xe1, 0x9f, 0xe1, 0xcc, 0x73, 0x40, 0xd6, 0x5b, 0xae, 0x17, 0x5b,
+  0x49, 0xb5, 0xa3, 0x3d, 0x5d, 0x2c, 0x61, 0xeb, 0x4a, 0x04, 0x5b, 0x3f, 0x1e, 0x87, 0x6d, 0xad,
+  0x54, 0x13, 0x76, 0x81, 0x8c, 0x9f, 0xab, 0xed, 0xdc, 0x0d, 0x6d, 0xbe, 0x4b, 0x9f, 0x10, 0xb0,
+  0xd6, 0xe6, 0x45, 0x78, 0x53, 0x07, 0x25, 0xf8, 0xaa, 0x34, 0xb1, 0x3d, 0x42, 0x72, 0x36, 0xbb,
+  0x05, 0xbf, 0xbc, 0xe9, 0xef, 0x30, 0x1e, 0x85, 0x37, 0x01, 0x1c, 0x1f, 0x1e, 0xd2, 0x3e, 0x6a,
+  0x9b, 0xa5, 0x54, 0x5e, 0x4c, 0xad, 0xf3, 0xb4, 0x91, 0x68, 0xe3, 0xc7, 0xe4, 0x09, 0x98, 0x54,
+  0xf9, 0xad, 0xf7, 0xa5, 0x1a, 0x57, 0x1e, 0x12, 0x2e, 0x53, 0x9f, 0x76, 0x0b, 0x5b, 0xe2, 0x5c,
+  0x28, 0xee, 0xf0, 0xc4, 0xdb, 0x5b, 0x30, 0xfd, 0x9d, 0xe1, 0x21, 0x84, 0x77, 0x02, 0xd9, 0x48,
+  0x47, 0x58, 0x33, 0x03, 0xe7, 0xd2, 0x9c, 0xae, 0x6e, 0xdd, 0x7f, 0xfd, 0xcf, 0xba, 0x5c, 0x14,
+  0x92, 0x0e, 0x03, 0x3e, 0x8d, 0x2e, 0x3f, 0x8b, 0x22, 0x2d, 0x1d, 0x50, 0x84, 0x20, 0xcc, 0x80,
+  0xb5, 0x5c, 0x43, 0x65, 0xe2, 0xed, 0x92, 0x4c, 0x33, 0x97, 0x47, 0x4f, 0x98, 0x6c, 0x30, 0xf9,
+  0x87, 0x02, 0xfd, 0x7d, 0x3c, 0x07, 0xa4, 0xe4, 0x2d, 0x12, 0xa1, 0xf5, 0x89, 0x49, 0xbc, 0xb8,
+  0x26, 0xe6, 0x31, 0xb0, 0x20, 0x3a, 0xd8, 0xd3, 0x8d, 0x18, 0x37, 0xac, 0x31, 0x29, 0xd8, 0xd9,
+  0xda, 0x1a, 0xbe, 0xa3, 0xc8, 0x8c, 0x01, 0x4e, 0x7e, 0x6b, 0x41, 0x42, 0x6c, 0x97, 0xa3, 0x12,
+  0xed, 0x8a, 0x8f, 0x82, 0x4c, 0x41, 0x6b, 0xdb, 0x42, 0xc9, 0x2c, 0x1e, 0x79, 0xe6, 0x41, 0x32,
+  0x6f, 0x1b, 0x68, 0xc6, 0xca, 0xc0, 0xff, 0x80, 0xed, 0x28, 0x13, 0x87, 0xe4, 0xe1, 0xde, 0x2f,
+  0xd7, 0x90, 0xed, 0xf7, 0x23, 0x30, 0x66, 0xfe, 0x34, 0x7c, 0xad, 0xde, 0x46, 0xa4, 0xd0, 0x60,
+  0x72, 0x3f, 0x65, 0x6f, 0xd8, 0xab, 0x23, 0xfc, 0x10, 0xa3, 0x4d, 0xb4, 0xfe, 0xa6, 0x4d, 0x38,
+  0xad, 0x32, 0x48, 0xba, 0x2f, 0x5f, 0x53, 0x56, 0x4d, 0x24, 0x5e, 0x88, 0xcb, 0x4a, 0xab, 0xf5,
+  0x95, 0x4d, 0x8e, 0x0e, 0xd6, 0xcb, 0x3e, 0xb6, 0xf2, 0x61, 0xe9, 0x39, 0x07, 0x95, 0x4f, 0x7d,
+  0x18, 0xf7, 0xa2, 0xb5, 0x3f, 0x99, 0xb6, 0xae, 0xbd, 0x3d, 0xdb, 0x09, 0x61, 0x7b, 0xbc, 0xdb,
+  0x65, 0x52, 0xb9, 0xb5, 0x6c, 0xdd, 0x2e, 0x75, 0x4a, 0x80, 0x74, 0xab, 0x7f, 0x01, 0xc0, 0x7b,
+  0xc8, 0xd2, 0xed, 0x07, 0x00, 0x00,
+};
@@ -0,0 +1,455 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// websocket_class.cpp : Class internals to push events and debug lines to browsers over WebSockets
+//
+// A deliberately small RFC 6455 server: text frames out, incoming frames are read only to notice a close.
+// Debug lines go out on it, so it is off unless WEBSOCKET_ENABLED, and asks for the admin login when one is set.
+// Nothing here ever waits on a socket. Each client has a bounded queue and when a client
+// falls behind its oldest frames are dropped, so one slow browser cannot stall loop().
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+
+#include "common.h"
+#include <ESP8266WiFi.h>
+#include <Hash.h>   // sha1()
+#include <base64.h> // base64::encode()
+
+WiFiServer webSocketServer(WEBSOCKET_PORT); // Server listening for WebSocket upgrades
+
+static const char webSocketGuid[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"; // RFC 6455 magic
+static const uint16_t webSocketRequestMax = 1024; // give up on an upgrade request longer than this
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::begin()
+{ // called in the main code setup, handles our initialisation
+#if WEBSOCKET_ENABLED==(true)
+  for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS; idx++)
+  { // the rings are the bulk of our RAM, so a plate with the stream off never pays for them
+    _clients[idx].ring = (uint8_t *)malloc(WEBSOCKET_BUFFER_SIZE);
+    if (_clients[idx].ring == NULL)
+    {
+      debug.printLn(F("WS: [ERROR] no heap for client buffers, server not started"));
+      for (uint8_t freeIdx = 0; freeIdx < idx; freeIdx++)
+      {
+        free(_clients[freeIdx].ring);
+        _clients[freeIdx].ring = NULL;
+      }
+      return;
+    }
+    _clients[idx].upgraded = false;
+    _clients[idx].head = 0;
+    _clients[idx].used = 0;
+    _clients[idx].headSent = 0;
+    _clients[idx].inSkip = 0;
+    _clients[idx].dropped = 0;
+  }
+  snprintf(_token, sizeof(_token), "%08x%08x", (unsigned int)ESP.random(), (unsigned int)ESP.random());
+  webSocketServer.begin();
+  webSocketServer.setNoDelay(true);
+  _alive = true;
+  debug.printLn(String(F("WS: Server started @ ws://")) + WiFi.localIP().toString() + ":" + String(WEBSOCKET_PORT) + "/");
+#endif // WEBSOCKET_ENABLED
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::loop()
+{ // called in the main code loop: accept, handshake, read a little and write what each socket will take
+  if (!_alive)
+  {
+    return;
+  }
+
+  if (webSocketServer.hasClient())
+  {
+    WiFiClient newClient = webSocketServer.available();
+    bool placed = false;
+    for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS && !placed; idx++)
+    {
+      if (!_clients[idx].client || !_clients[idx].client.connected())
+      {
+        _close(_clients[idx]);
+        _clients[idx].client = newClient;
+        _clients[idx].dropped = 0;
+        placed = true;
+      }
+    }
+    if (!placed)
+    { // full house, turn them away
+      newClient.stop();
+    }
+  }
+
+  for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS; idx++)
+  {
+    wsClient_t &ws = _clients[idx];
+    if (!ws.client)
+    {
+      continue;
+    }
+    if (!ws.client.connected())
+    {
+      _close(ws);
+      continue;
+    }
+    if (!ws.upgraded)
+    {
+      _handshake(ws);
+    }
+    else
+    {
+      _readInput(ws);
+      _drain(ws);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::sendButton(String page, String buttonID, String newState)
+{
+  _broadcast(String(F("{\"type\":\"button\",\"page\":")) + page + String(F(",\"button\":")) + buttonID + String(F(",\"event\":\"")) + newState + String(F("\"}")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::sendPage(String page)
+{
+  _broadcast(String(F("{\"type\":\"page\",\"page\":")) + page + String(F("}")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::sendLog(const String &debugText)
+{ // called from debug.printLn(), so nothing in here may print debug
+  if (getClientCount() == 0)
+  { // don't bother escaping a line nobody will read
+    return;
+  }
+  _broadcast(String(F("{\"type\":\"log\",\"msg\":\"")) + _escape(debugText) + String(F("\"}")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint8_t WebSocketClass::getClientCount()
+{
+  uint8_t count = 0;
+  if (!_alive)
+  {
+    return 0;
+  }
+  for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS; idx++)
+  {
+    if (_clients[idx].upgraded)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t WebSocketClass::getDroppedCount()
+{
+  uint32_t count = 0;
+  if (!_alive)
+  {
+    return 0;
+  }
+  for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS; idx++)
+  {
+    count += _clients[idx].dropped;
+  }
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_broadcast(const String &message)
+{ // queue only, the sockets are written from loop()
+  if (!_alive)
+  {
+    return;
+  }
+  for (uint8_t idx = 0; idx < WEBSOCKET_MAX_CLIENTS; idx++)
+  {
+    if (_clients[idx].upgraded)
+    {
+      _queueFrame(_clients[idx], message);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_queueFrame(wsClient_t &ws, const String &message)
+{ // Wrap message as a single unmasked text frame and add it to the client ring, dropping the oldest to make room
+  uint16_t payloadLength = message.length();
+  if (payloadLength > (WEBSOCKET_BUFFER_SIZE / 2))
+  { // a single huge line would empty the whole queue, trim it
+    payloadLength = WEBSOCKET_BUFFER_SIZE / 2;
+  }
+  uint8_t header[4];
+  uint8_t headerLength = 2;
+  header[0] = 0x81; // FIN + text
+  if (payloadLength < 126)
+  {
+    header[1] = payloadLength;
+  }
+  else
+  {
+    header[1] = 126;
+    header[2] = payloadLength >> 8;
+    header[3] = payloadLength & 0xFF;
+    headerLength = 4;
+  }
+  uint16_t frameLength = headerLength + payloadLength;
+  uint16_t entryLength = frameLength + 2;
+
+  while ((WEBSOCKET_BUFFER_SIZE - ws.used) < entryLength)
+  {
+    if (ws.used == 0 || (ws.headSent > 0 && ws.used == (((uint16_t)ws.ring[ws.head] << 8) | ws.ring[(ws.head + 1) % WEBSOCKET_BUFFER_SIZE]) + 2))
+    { // nothing left we are allowed to drop, the only frame is already half on the wire
+      ws.dropped++;
+      return;
+    }
+    _dropOldest(ws);
+  }
+
+  uint16_t tail = (ws.head + ws.used) % WEBSOCKET_BUFFER_SIZE;
+  ws.ring[tail] = frameLength >> 8;
+  tail = (tail + 1) % WEBSOCKET_BUFFER_SIZE;
+  ws.ring[tail] = frameLength & 0xFF;
+  tail = (tail + 1) % WEBSOCKET_BUFFER_SIZE;
+  for (uint8_t idx = 0; idx < headerLength; idx++)
+  {
+    ws.ring[tail] = header[idx];
+    tail = (tail + 1) % WEBSOCKET_BUFFER_SIZE;
+  }
+  for (uint16_t idx = 0; idx < payloadLength; idx++)
+  {
+    ws.ring[tail] = message[idx];
+    tail = (tail + 1) % WEBSOCKET_BUFFER_SIZE;
+  }
+  ws.used += entryLength;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_dropOldest(wsClient_t &ws)
+{ // Drop the oldest frame nobody has started sending. If the head frame is part sent it must finish
+  // or the stream would be corrupt, so the frame behind it goes instead
+  uint16_t victim = ws.head;
+  if (ws.headSent > 0)
+  {
+    uint16_t headLength = ((uint16_t)ws.ring[ws.head] << 8) | ws.ring[(ws.head + 1) % WEBSOCKET_BUFFER_SIZE];
+    victim = (ws.head + headLength + 2) % WEBSOCKET_BUFFER_SIZE;
+  }
+  uint16_t victimLength = (((uint16_t)ws.ring[victim] << 8) | ws.ring[(victim + 1) % WEBSOCKET_BUFFER_SIZE]) + 2;
+
+  if (victim != ws.head)
+  { // close the gap by sliding the part sent head frame forward over the victim
+    uint16_t headLength = ((uint16_t)ws.ring[ws.head] << 8) | ws.ring[(ws.head + 1) % WEBSOCKET_BUFFER_SIZE];
+    for (int32_t idx = headLength + 1; idx >= 0; idx--)
+    {
+      ws.ring[(ws.head + idx + victimLength) % WEBSOCKET_BUFFER_SIZE] = ws.ring[(ws.head + idx) % WEBSOCKET_BUFFER_SIZE];
+    }
+  }
+  ws.head = (ws.head + victimLength) % WEBSOCKET_BUFFER_SIZE;
+  ws.used -= victimLength;
+  ws.dropped++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_drain(wsClient_t &ws)
+{ // Write only as much as the socket will take right now, and pick up from there next loop
+  while (ws.used > 0)
+  {
+    size_t writable = ws.client.availableForWrite();
+    if (writable == 0)
+    {
+      return;
+    }
+    uint16_t frameLength = ((uint16_t)ws.ring[ws.head] << 8) | ws.ring[(ws.head + 1) % WEBSOCKET_BUFFER_SIZE];
+    uint16_t frameStart = (ws.head + 2 + ws.headSent) % WEBSOCKET_BUFFER_SIZE;
+    uint16_t remaining = frameLength - ws.headSent;
+    uint16_t contiguous = WEBSOCKET_BUFFER_SIZE - frameStart; // the ring may wrap mid frame
+    uint16_t toSend = remaining;
+    if (toSend > contiguous)
+    {
+      toSend = contiguous;
+    }
+    if (toSend > writable)
+    {
+      toSend = writable;
+    }
+    size_t sent = ws.client.write(&ws.ring[frameStart], toSend);
+    if (sent == 0)
+    {
+      return;
+    }
+    ws.headSent += sent;
+    if (ws.headSent >= frameLength)
+    { // whole frame is out, release it
+      ws.head = (ws.head + frameLength + 2) % WEBSOCKET_BUFFER_SIZE;
+      ws.used -= frameLength + 2;
+      ws.headSent = 0;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_handshake(wsClient_t &ws)
+{ // Collect the HTTP upgrade request as it arrives and answer it once the blank line shows up
+  while (ws.client.available() && ws.request.length() < webSocketRequestMax)
+  {
+    ws.request += char(ws.client.read());
+  }
+  if (ws.request.length() >= webSocketRequestMax)
+  {
+    _close(ws);
+    return;
+  }
+  if (ws.request.indexOf("\r\n\r\n") < 0)
+  {
+    return; // not all here yet
+  }
+
+  int keyStart = ws.request.indexOf(F("Sec-WebSocket-Key:"));
+  if (keyStart < 0)
+  {
+    ws.client.print(F("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n"));
+    _close(ws);
+    return;
+  }
+  if (!_authorised(ws.request))
+  {
+    ws.client.print(F("HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic realm=\"HASP\"\r\nConnection: close\r\n\r\n"));
+    _close(ws);
+    return;
+  }
+  keyStart += 18;
+  String acceptKey = ws.request.substring(keyStart, ws.request.indexOf("\r\n", keyStart));
+  acceptKey.trim();
+  acceptKey += FPSTR(webSocketGuid);
+  uint8_t acceptHash[20];
+  sha1((uint8_t *)acceptKey.c_str(), acceptKey.length(), acceptHash);
+
+  ws.client.print(String(F("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ")) + base64::encode(acceptHash, 20, false) + String(F("\r\n\r\n")));
+  ws.request = "";
+  ws.upgraded = true;
+  ws.head = 0;
+  ws.used = 0;
+  ws.headSent = 0;
+  ws.inSkip = 0;
+  _queueFrame(ws, String(F("{\"type\":\"hello\",\"node\":\"")) + String(config.getHaspNode()) + String(F("\",\"page\":")) + String(nextion.getActivePage()) + String(F("}")));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool WebSocketClass::_authorised(const String &request)
+{ // Same rule as the admin pages: open when no password is set, otherwise the admin login as Basic auth
+  // or the token from the /events page, which browsers have to use as they cannot set headers on a WebSocket
+  if (web.getPassword()[0] == '\0')
+  {
+    return true;
+  }
+  int tokenStart = request.indexOf(F("token="));
+  int lineEnd = request.indexOf("\r\n");
+  if ((tokenStart >= 0) && (tokenStart < lineEnd))
+  { // only look in the request line, "GET /?token=... HTTP/1.1"
+    tokenStart += 6;
+    int tokenEnd = request.indexOf(' ', tokenStart);
+    if ((tokenEnd > tokenStart) && request.substring(tokenStart, tokenEnd).equals(_token))
+    {
+      return true;
+    }
+  }
+  int authStart = request.indexOf(F("Authorization: Basic "));
+  if (authStart >= 0)
+  {
+    authStart += 21;
+    String credentials = request.substring(authStart, request.indexOf("\r\n", authStart));
+    credentials.trim();
+    String expected = String(web.getUser()) + ":" + String(web.getPassword());
+    if (credentials.equals(base64::encode((uint8_t *)expected.c_str(), expected.length(), false)))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_readInput(wsClient_t &ws)
+{ // Browsers only talk to us to ping or to close. Skip payloads, act on close
+  while (ws.client.available())
+  {
+    if (ws.inSkip > 0)
+    {
+      ws.client.read();
+      ws.inSkip--;
+      continue;
+    }
+    if (ws.client.available() < 6)
+    { // smallest client frame is 2 header + 4 mask bytes, wait for the rest
+      return;
+    }
+    uint8_t opcode = ws.client.read() & 0x0F;
+    uint8_t payloadLength = ws.client.read() & 0x7F;
+    if (payloadLength >= 126)
+    { // pings and closes are always short, nobody sends us big frames for a reason we want
+      _close(ws);
+      return;
+    }
+    for (uint8_t idx = 0; idx < 4; idx++)
+    { // mask key, not needed as we never look at the payload
+      ws.client.read();
+    }
+    if (opcode == 0x08)
+    { // close
+      _close(ws);
+      return;
+    }
+    ws.inSkip = payloadLength;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void WebSocketClass::_close(wsClient_t &ws)
+{
+  if (ws.client)
+  {
+    ws.client.stop();
+  }
+  ws.upgraded = false;
+  ws.request = "";
+  ws.head = 0;
+  ws.used = 0;
+  ws.headSent = 0;
+  ws.inSkip = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+String WebSocketClass::_escape(const String &text)
+{ // Just enough JSON string escaping for debug lines
+  String escaped;
+  escaped.reserve(text.length() + 8);
+  for (uint16_t idx = 0; idx < text.length(); idx++)
+  {
+    char character = text[idx];
+    if (character == '"' || character == '\\')
+    {
+      escaped += '\\';
+      escaped += character;
+    }
+    else if ((uint8_t)character < 0x20)
+    {
+      escaped += ' ';
+    }
+    else
+    {
+      escaped += character;
+    }
+  }
+  return escaped;
+}
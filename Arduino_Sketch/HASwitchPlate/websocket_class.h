@@ -0,0 +1,106 @@
+// -*- C++ -*-
+// HASwitchPlate Forked
+//
+// Inherits MIT license from HASwitchPlate.ino
+// most Copyright (c) 2019 Allen Derusha allen@derusha.org
+// little changes Copyright (C) 2020 Gerard Sharp (find me on GitHub)
+//
+//
+// websocket_class.h : A class to push events and debug lines to browsers over WebSockets
+//
+// ----------------------------------------------------------------------------------------------------------------- //
+
+
+// This file is only #included once, mmkay
+#pragma once
+
+#include "settings.h"
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+// Each client has its own byte ring of complete, ready to send WebSocket frames
+// every frame is stored behind a two byte length so the oldest can be dropped whole
+typedef struct _ws_client_struct {
+  WiFiClient client;
+  bool     upgraded;                      // handshake is done, frames may flow
+  String   request;                       // HTTP upgrade request, collected a little at a time
+  uint8_t *ring;                          // WEBSOCKET_BUFFER_SIZE of queued frames, [len hi][len lo][frame...]. malloc'd in begin() only when enabled
+  uint16_t head;                          // offset of the oldest queued frame
+  uint16_t used;                          // bytes in use in ring
+  uint16_t headSent;                      // bytes of the oldest frame already written to the socket
+  uint16_t inSkip;                        // bytes of an incoming frame payload still to discard
+  uint32_t dropped;                       // frames dropped because this client could not keep up
+} wsClient_t;
+
+class WebSocketClass {
+private:
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // constructor
+  WebSocketClass(void) { _alive = false; _token[0] = '\0'; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // destructor
+  ~WebSocketClass(void) { _alive = false; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void begin();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void loop();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void sendButton(String page, String buttonID, String newState);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void sendPage(String page);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void sendLog(const String &debugText);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  uint8_t getClientCount();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  uint32_t getDroppedCount();
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // random per boot, handed to the logged in /events page so the browser can pass it as ?token=
+  inline const char *getToken() { return _token; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  inline bool getEnabled() { return _alive; }
+
+protected:
+  bool       _alive;
+  wsClient_t _clients[WEBSOCKET_MAX_CLIENTS];
+  char       _token[17];
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _broadcast(const String &message);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _queueFrame(wsClient_t &ws, const String &message);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _dropOldest(wsClient_t &ws);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _drain(wsClient_t &ws);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _handshake(wsClient_t &ws);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  bool _authorised(const String &request);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _readInput(wsClient_t &ws);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void _close(wsClient_t &ws);
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  String _escape(const String &text);
+
+};
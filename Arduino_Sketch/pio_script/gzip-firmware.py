@@ -0,0 +1,41 @@
+# HASwitchPlate Forked
+#
+# gzip-firmware.py : produce a gzipped copy of the ESP firmware image for HTTP OTA
+#
+# Writes <firmware>.bin.gz next to the .bin after each PlatformIO build and prints the
+# sizes and MD5s to put in update/version.json. Run by PlatformIO as a post: extra_script,
+# or by hand with: python pio_script/gzip-firmware.py path/to/firmware.bin
+#
+# Flashing a gzipped image needs ESP8266 core 2.7.0 or later, see ESP_OTA_GZIP_ENABLED
+#
+import gzip
+import hashlib
+import os
+import sys
+
+
+def pack(firmware):
+    with open(firmware, "rb") as handle:
+        raw = handle.read()
+    # mtime=0 so the same image always gives the same bytes, and so the same MD5
+    packed = gzip.compress(raw, compresslevel=9, mtime=0)
+    output = firmware + ".gz"
+    with open(output, "wb") as handle:
+        handle.write(packed)
+    print("gzip-firmware: %s %d bytes md5 %s" % (os.path.basename(firmware), len(raw), hashlib.md5(raw).hexdigest()))
+    print("gzip-firmware: %s %d bytes md5 %s (%d%%)" % (os.path.basename(output), len(packed), hashlib.md5(packed).hexdigest(), (len(packed) * 100) // len(raw)))
+    return output
+
+
+def after_build(source, target, env):
+    pack(target[0].get_abspath())
+
+
+try:
+    Import("env")  # noqa: F821 -- provided by PlatformIO
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", after_build)  # noqa: F821
+except NameError:
+    if len(sys.argv) != 2:
+        print("usage: python pio_script/gzip-firmware.py path/to/firmware.bin")
+        sys.exit(1)
+    pack(sys.argv[1])
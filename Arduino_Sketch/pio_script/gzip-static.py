@@ -0,0 +1,78 @@
+# HASwitchPlate Forked
+#
+# gzip-static.py : pack the admin page CSS/JS into PROGMEM
+#
+# Reads web_static/hasp.css and web_static/hasp.js, gzips them and writes
+# HASwitchPlate/web_static.h with one PROGMEM array and one strong ETag per file.
+# Run by PlatformIO as a pre: extra_script, or by hand with: python pio_script/gzip-static.py
+#
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 -- provided by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+STATIC_DIR = os.path.join(PROJECT_DIR, "web_static")
+OUTPUT = os.path.join(PROJECT_DIR, "HASwitchPlate", "web_static.h")
+
+# source file, C array name, ETag define
+STATIC_FILES = [
+    ("hasp.css", "WEB_STATIC_CSS", "WEB_STATIC_CSS_ETAG"),
+    ("hasp.js", "WEB_STATIC_JS", "WEB_STATIC_JS_ETAG"),
+]
+
+
+def pack(source):
+    with open(os.path.join(STATIC_DIR, source), "rb") as handle:
+        raw = handle.read()
+    # mtime=0 so the same input always gives the same bytes, and so the same ETag
+    packed = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(raw).hexdigest()[:16]
+    return raw, packed, etag
+
+
+def render():
+    lines = [
+        "// -*- C++ -*-",
+        "// HASwitchPlate Forked",
+        "//",
+        "// web_static.h : gzipped admin page CSS/JS, GENERATED by pio_script/gzip-static.py",
+        "// edit the files in web_static/ and rebuild, do not edit this file",
+        "//",
+        "// ----------------------------------------------------------------------------------------------------------------- //",
+        "",
+        "// This file is only #included once, mmkay",
+        "#pragma once",
+        "",
+        "#include <Arduino.h>",
+        "",
+    ]
+    for source, array, etag_define in STATIC_FILES:
+        raw, packed, etag = pack(source)
+        lines.append("// %s: %d bytes, %d bytes gzipped" % (source, len(raw), len(packed)))
+        lines.append("#define %s (\"\\\"%s\\\"\")" % (etag_define, etag))
+        lines.append("static const uint8_t %s[] PROGMEM = {" % array)
+        for offset in range(0, len(packed), 16):
+            row = ", ".join("0x%02x" % byte for byte in packed[offset:offset + 16])
+            lines.append("  %s," % row)
+        lines.append("};")
+        lines.append("")
+    return "\n".join(lines)
+
+
+def main():
+    content = render()
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, "r") as handle:
+            if handle.read() == content:
+                return  # unchanged, leave the timestamp alone so nothing rebuilds
+    with open(OUTPUT, "w") as handle:
+        handle.write(content)
+    print("gzip-static: wrote %s" % OUTPUT)
+
+
+main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# HASwitchPlate Forked
+#
+# hasp-trace.py : decode a binary trace snapshot from http://<plate>/api/trace
+#
+#   curl -u admin:password -o plate01.trace http://plate01/api/trace
+#   python3 tools/hasp-trace.py plate01.trace                      # readable log on stdout
+#   python3 tools/hasp-trace.py plate01.trace --chrome plate01.json # plus chrome://tracing / Perfetto JSON
+#
+# Layout (little endian), see HASwitchPlate/trace_class.h:
+#   header: char magic[4]="HTRC", u8 version, u8 eventSize, u16 count, u32 nowMicros, u32 lost
+#   event:  u32 micros, u8 id, u8 arg8, u16 arg16
+#
+import argparse
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("<4sBBHII")
+EVENT = struct.Struct("<IBBH")
+
+# keep in step with trace_t and tracePhase_t in trace_class.h
+EVENT_NAMES = {
+    1: "PHASE",
+    2: "UART_RX",
+    3: "UART_TX",
+    4: "MQTT_IN",
+    5: "MQTT_OUT",
+    6: "MARK",
+}
+PHASE_NAMES = ["idle", "nextion", "esp", "mqtt", "ota", "web", "websocket", "beep", "debug"]
+
+# Chrome trace thread per kind of event, so phases and I/O get their own rows
+THREADS = {1: (1, "loop"), 2: (2, "uart"), 3: (2, "uart"), 4: (3, "mqtt"), 5: (3, "mqtt"), 6: (4, "mark")}
+
+
+def load(path):
+    with open(path, "rb") as handle:
+        data = handle.read()
+    if len(data) < HEADER.size:
+        sys.exit("%s: too short for a trace header" % path)
+    magic, version, event_size, count, now_micros, lost = HEADER.unpack_from(data, 0)
+    if magic != b"HTRC" or version != 1 or event_size != EVENT.size:
+        sys.exit("%s: not a version 1 HASP trace" % path)
+    events = []
+    offset = HEADER.size
+    # micros() wraps every ~71 minutes, so unwrap against the previous event
+    base = 0
+    previous = None
+    for _ in range(count):
+        if offset + EVENT.size > len(data):
+            sys.exit("%s: truncated after %d events" % (path, len(events)))
+        micros, event_id, arg8, arg16 = EVENT.unpack_from(data, offset)
+        offset += EVENT.size
+        if previous is not None and micros < previous:
+            base += 1 << 32
+        previous = micros
+        events.append((base + micros, event_id, arg8, arg16))
+    return events, lost
+
+
+def describe(event_id, arg8, arg16):
+    name = EVENT_NAMES.get(event_id, "EVENT_%d" % event_id)
+    if event_id == 1:
+        return name, PHASE_NAMES[arg8] if arg8 < len(PHASE_NAMES) else "phase_%d" % arg8
+    if event_id == 2:
+        return name, "type=0x%02x len=%d" % (arg8, arg16)
+    if event_id in (3, 4, 5):
+        return name, "len=%d" % arg16
+    return name, "arg8=%d arg16=%d" % (arg8, arg16)
+
+
+def print_log(events, lost):
+    if lost:
+        print("# %d older events were overwritten before this snapshot" % lost)
+    if not events:
+        return
+    start = events[0][0]
+    previous = start
+    for micros, event_id, arg8, arg16 in events:
+        name, detail = describe(event_id, arg8, arg16)
+        print("%12.3fms %+9dus  %-8s %s" % ((micros - start) / 1000.0, micros - previous, name, detail))
+        previous = micros
+
+
+def chrome(events):
+    trace = []
+    for tid, label in set(THREADS.values()):
+        trace.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": label}})
+    # the plate closes every phase it records with an idle mark, as short empty phases are left out and
+    # the next mark may be well after this phase ended. Any phase mark ends the open one
+    open_phase = None
+    for micros, event_id, arg8, arg16 in events:
+        name, detail = describe(event_id, arg8, arg16)
+        tid = THREADS.get(event_id, (4, "mark"))[0]
+        if event_id == 1:
+            if open_phase is not None:
+                start, phase_name = open_phase
+                trace.append({"name": phase_name, "ph": "X", "pid": 1, "tid": tid, "ts": start, "dur": micros - start})
+            open_phase = (micros, detail) if arg8 != 0 else None
+        else:
+            trace.append({"name": name, "ph": "i", "s": "t", "pid": 1, "tid": tid, "ts": micros,
+                          "args": {"arg8": arg8, "arg16": arg16, "detail": detail}})
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a HASwitchPlate /api/trace snapshot")
+    parser.add_argument("snapshot", help="file saved from http://<plate>/api/trace")
+    parser.add_argument("--chrome", metavar="JSON", help="also write Chrome trace event JSON here")
+    parser.add_argument("--quiet", action="store_true", help="skip the readable log")
+    args = parser.parse_args()
+
+    events, lost = load(args.snapshot)
+    if not args.quiet:
+        print_log(events, lost)
+    if args.chrome:
+        with open(args.chrome, "w") as handle:
+            json.dump(chrome(events), handle)
+        print("# wrote %s, open it in chrome://tracing or ui.perfetto.dev" % args.chrome, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
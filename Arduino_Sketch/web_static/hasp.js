@@ -0,0 +1,31 @@
+function handleLcdFileSelect(evt) {
+  var uploadFile = evt.target.files[0];
+  document.getElementById('lcdUploadSubmit').innerHTML = 'Upload LCD firmware ' + uploadFile.name;
+  var tftFileSize = '/tftFileSize?tftFileSize=' + uploadFile.size;
+  var xhttp = new XMLHttpRequest(); xhttp.open('GET', tftFileSize, true); xhttp.send();
+}
+function ackLcdUploadSubmit() { document.getElementById('lcdUploadSubmit').innerHTML = 'Uploading LCD firmware...'; }
+function handleEspFileSelect(evt) { var uploadFile = evt.target.files[0]; document.getElementById('espUploadSubmit').innerHTML = 'Upload ESP firmware ' + uploadFile.name; }
+function ackEspUploadSubmit() { document.getElementById('espUploadSubmit').innerHTML = 'Uploading ESP firmware...'; }
+window.addEventListener('DOMContentLoaded', function () {
+  var lcdSelect = document.getElementById('lcdSelect');
+  var espSelect = document.getElementById('espSelect');
+  if (lcdSelect) { lcdSelect.addEventListener('change', handleLcdFileSelect, false); }
+  if (espSelect) { espSelect.addEventListener('change', handleEspFileSelect, false); }
+});
+window.addEventListener('DOMContentLoaded', function () {
+  var wsLog = document.getElementById('wsLog');
+  if (!wsLog) { return; }
+  var socket = new WebSocket('ws://' + location.hostname + ':' + wsLog.getAttribute('data-port') + '/?token=' + wsLog.getAttribute('data-token'));
+  socket.onmessage = function (evt) {
+    var event = JSON.parse(evt.data);
+    var line = event.msg;
+    if (event.type === 'button') { line = 'p[' + event.page + '].b[' + event.button + '] ' + event.event; }
+    else if (event.type === 'page') { line = 'page ' + event.page; }
+    else if (event.type === 'hello') { line = 'connected to ' + event.node + ', page ' + event.page; }
+    wsLog.textContent += line + '\n';
+    if (wsLog.textContent.length > 20000) { wsLog.textContent = wsLog.textContent.slice(-15000); }
+    window.scrollTo(0, document.body.scrollHeight);
+  };
+  socket.onclose = function () { wsLog.textContent += '-- disconnected --\n'; };
+});